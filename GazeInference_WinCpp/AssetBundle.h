@@ -0,0 +1,234 @@
+#pragma once
+#include "framework.h"
+#include "MappedFile.h"
+#include <cstdint>
+#include <cstring>
+
+
+/*
+* Asset bundle file layout (little endian)
+*
+*   AssetBundleHeader
+*   AssetSectionEntry[section_count]
+*   <padding> section 0 <padding> section 1 ...
+*
+* Every section starts on an ASSET_BUNDLE_ALIGNMENT boundary so it can be used
+* straight from the mapping (typed arrays, ORT model bytes). Mapping the bundle
+* read-only lets every tracker process on the host share the same pages.
+* Each entry records the size and write time of the file it was packed from;
+* a bundle whose source files changed since is not opened.
+*/
+const uint32_t ASSET_BUNDLE_VERSION = 2;
+const uint64_t ASSET_BUNDLE_ALIGNMENT = 4096;
+const char ASSET_BUNDLE_MAGIC[8] = { 'G', 'Z', 'B', 'U', 'N', 'D', 'L', 'E' };
+
+enum ASSET_KIND { RAW = 0, ONNX_MODEL = 1, FLAT_SHAPE_PREDICTOR = 2 };
+
+#pragma pack(push, 1)
+struct AssetBundleHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t section_count;
+    uint64_t file_size;
+};
+
+struct AssetSourceFingerprint {
+    uint64_t size;
+    uint64_t write_time;    // FILETIME
+};
+
+struct AssetSectionEntry {
+    char name[48];
+    uint32_t kind;
+    uint32_t reserved;
+    uint64_t offset;
+    uint64_t size;
+    wchar_t source_path[260];   // empty for sections without a source file
+    AssetSourceFingerprint source;
+};
+#pragma pack(pop)
+
+// False when the file does not exist
+inline bool asset_source_fingerprint(const std::wstring& path, AssetSourceFingerprint& fingerprint) {
+    WIN32_FILE_ATTRIBUTE_DATA attributes;
+    if (!GetFileAttributesExW(path.c_str(), GetFileExInfoStandard, &attributes))
+        return false;
+    fingerprint.size = ((uint64_t)attributes.nFileSizeHigh << 32) | attributes.nFileSizeLow;
+    fingerprint.write_time = ((uint64_t)attributes.ftLastWriteTime.dwHighDateTime << 32) | attributes.ftLastWriteTime.dwLowDateTime;
+    return true;
+}
+
+struct AssetSection {
+    const void* data = nullptr;
+    size_t size = 0;
+    uint32_t kind = ASSET_KIND::RAW;
+
+    explicit operator bool() const {
+        return data != nullptr;
+    }
+};
+
+
+class AssetBundle {
+private:
+    MappedFile file;
+    const AssetBundleHeader* header = nullptr;
+    const AssetSectionEntry* entries = nullptr;
+
+    // A source file replaced since packing makes the bundle stale, a removed one does not
+    bool sources_current() const {
+        for (uint32_t i = 0; i < header->section_count; i++) {
+            const AssetSectionEntry& entry = entries[i];
+            std::wstring source(entry.source_path, wcsnlen(entry.source_path, sizeof(entry.source_path) / sizeof(wchar_t)));
+            AssetSourceFingerprint current;
+            if (source.empty() || !asset_source_fingerprint(source, current))
+                continue;
+            if (current.size != entry.source.size || current.write_time != entry.source.write_time) {
+                LOG_WARN("Source of asset %s changed since the asset bundle was built.\n", entry.name);
+                return false;
+            }
+        }
+        return true;
+    }
+
+public:
+    AssetBundle() {}
+
+    bool open(const std::wstring& path) {
+        if (!file.open(path))
+            return false;
+
+        const uint8_t* base = static_cast<const uint8_t*>(file.data());
+        if (file.size() < sizeof(AssetBundleHeader)) {
+            file.close();
+            return false;
+        }
+        header = reinterpret_cast<const AssetBundleHeader*>(base);
+        entries = reinterpret_cast<const AssetSectionEntry*>(base + sizeof(AssetBundleHeader));
+
+        bool is_valid = memcmp(header->magic, ASSET_BUNDLE_MAGIC, sizeof(ASSET_BUNDLE_MAGIC)) == 0
+            && header->version == ASSET_BUNDLE_VERSION
+            && header->file_size == file.size()
+            && sizeof(AssetBundleHeader) + header->section_count * sizeof(AssetSectionEntry) <= file.size();
+        for (uint32_t i = 0; is_valid && i < header->section_count; i++) {
+            is_valid = entries[i].offset % ASSET_BUNDLE_ALIGNMENT == 0
+                && entries[i].offset + entries[i].size <= file.size();
+        }
+
+        if (!is_valid)
+            LOG_ERROR("Invalid or outdated asset bundle.\n");
+        else
+            is_valid = sources_current();
+
+        if (!is_valid) {
+            header = nullptr;
+            entries = nullptr;
+            file.close();
+        }
+        return is_valid;
+    }
+
+    bool is_open() const {
+        return header != nullptr;
+    }
+
+    AssetSection section(const std::string& name) const {
+        AssetSection result;
+        if (!is_open())
+            return result;
+
+        for (uint32_t i = 0; i < header->section_count; i++) {
+            if (strncmp(entries[i].name, name.c_str(), sizeof(entries[i].name)) == 0) {
+                result.data = static_cast<const uint8_t*>(file.data()) + entries[i].offset;
+                result.size = static_cast<size_t>(entries[i].size);
+                result.kind = entries[i].kind;
+                break;
+            }
+        }
+        return result;
+    }
+};
+
+
+class AssetBundleWriter {
+private:
+    struct PendingSection {
+        std::string name;
+        uint32_t kind;
+        std::vector<char> bytes;
+        std::wstring source_path;
+    };
+    std::vector<PendingSection> sections;
+
+    static uint64_t align(uint64_t offset) {
+        return (offset + ASSET_BUNDLE_ALIGNMENT - 1) / ASSET_BUNDLE_ALIGNMENT * ASSET_BUNDLE_ALIGNMENT;
+    }
+
+public:
+    // sourcePath is the file the bytes were derived from, a bundle is stale once it changes
+    void add_bytes(const std::string& name, uint32_t kind, std::vector<char> bytes, const std::wstring& sourcePath = std::wstring()) {
+        sections.push_back({ name, kind, std::move(bytes), sourcePath });
+    }
+
+    bool add_file(const std::string& name, uint32_t kind, const std::wstring& path) {
+        std::ifstream in(path, std::ios::binary);
+        if (!in.is_open()) {
+            LOG_WARN("Asset %s not found, skipped.\n", name.c_str());
+            return false;
+        }
+        std::vector<char> bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        add_bytes(name, kind, std::move(bytes), path);
+        return true;
+    }
+
+    bool empty() const {
+        return sections.empty();
+    }
+
+    bool write(const std::wstring& path) {
+        std::vector<AssetSectionEntry> entries(sections.size());
+        uint64_t offset = align(sizeof(AssetBundleHeader) + sections.size() * sizeof(AssetSectionEntry));
+        for (size_t i = 0; i < sections.size(); i++) {
+            memset(&entries[i], 0, sizeof(AssetSectionEntry));
+            strncpy_s(entries[i].name, sections[i].name.c_str(), _TRUNCATE);
+            entries[i].kind = sections[i].kind;
+            entries[i].offset = offset;
+            entries[i].size = sections[i].bytes.size();
+            if (asset_source_fingerprint(sections[i].source_path, entries[i].source))
+                wcsncpy_s(entries[i].source_path, sections[i].source_path.c_str(), _TRUNCATE);
+            offset = align(offset + entries[i].size);
+        }
+
+        AssetBundleHeader header;
+        memcpy(header.magic, ASSET_BUNDLE_MAGIC, sizeof(ASSET_BUNDLE_MAGIC));
+        header.version = ASSET_BUNDLE_VERSION;
+        header.section_count = static_cast<uint32_t>(sections.size());
+        header.file_size = sections.empty() ? sizeof(AssetBundleHeader) : entries.back().offset + entries.back().size;
+
+        // Write to a temporary file first so a concurrently starting tracker
+        // never maps a partially written bundle
+        std::wstring tempPath = path + L"." + std::to_wstring(GetCurrentProcessId()) + L".tmp";
+        {
+            std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+            if (!out.is_open())
+                return false;
+
+            out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            out.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(AssetSectionEntry));
+            for (size_t i = 0; i < sections.size(); i++) {
+                // zero padding up to the section boundary
+                std::vector<char> padding(static_cast<size_t>(entries[i].offset - static_cast<uint64_t>(out.tellp())), 0);
+                out.write(padding.data(), padding.size());
+                out.write(sections[i].bytes.data(), sections[i].bytes.size());
+            }
+            if (!out.good())
+                return false;
+        }
+
+        if (!MoveFileExW(tempPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING)) {
+            DeleteFileW(tempPath.c_str());
+            return false;
+        }
+        return true;
+    }
+};
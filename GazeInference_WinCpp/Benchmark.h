@@ -0,0 +1,201 @@
+#pragma once
+#include "framework.h"
+#include <map>
+#include <sstream>
+
+
+struct LatencyStats {
+    size_t count = 0;
+    double min_us = 0;
+    double p50_us = 0;
+    double p90_us = 0;
+    double p99_us = 0;
+    double max_us = 0;
+    double mean_us = 0;
+};
+
+/*
+* Collects nanosecond samples per named stage and summarizes them as
+* min/p50/p90/p99/max. Stages keep the order they were first recorded in.
+*/
+class BenchmarkReport {
+private:
+    std::string name;
+    std::vector<std::string> stage_order;
+    std::map<std::string, std::vector<int64_t>> samples_ns;
+    std::map<std::string, std::string> properties;
+    int64_t wall_ns = 0;
+    size_t frames = 0;
+
+    static double percentile(const std::vector<int64_t>& sorted, double p) {
+        // nearest rank
+        size_t rank = (size_t)std::ceil(p / 100.0 * sorted.size());
+        return sorted[std::min(sorted.size() - 1, rank > 0 ? rank - 1 : 0)] / 1000.0;
+    }
+
+    static std::string escape(const std::string& text) {
+        std::string escaped;
+        for (char c : text) {
+            if (c == '"' || c == '\\')
+                escaped += '\\';
+            escaped += c;
+        }
+        return escaped;
+    }
+
+public:
+    BenchmarkReport(const std::string& name) : name{ name } {}
+
+    void add(const std::string& stage, int64_t ns) {
+        auto& samples = samples_ns[stage];
+        if (samples.empty())
+            stage_order.push_back(stage);
+        samples.push_back(ns);
+    }
+
+    void set_property(const std::string& key, const std::string& value) {
+        properties[key] = value;
+    }
+
+    // Wall time and number of frames (or kernel calls) for the throughput
+    void set_throughput(size_t count, int64_t elapsed_ns) {
+        frames = count;
+        wall_ns = elapsed_ns;
+    }
+
+    LatencyStats stats(const std::string& stage) {
+        LatencyStats result;
+        auto it = samples_ns.find(stage);
+        if (it == samples_ns.end() || it->second.empty())
+            return result;
+
+        std::vector<int64_t> sorted = it->second;
+        std::sort(sorted.begin(), sorted.end());
+        result.count = sorted.size();
+        result.min_us = sorted.front() / 1000.0;
+        result.p50_us = percentile(sorted, 50);
+        result.p90_us = percentile(sorted, 90);
+        result.p99_us = percentile(sorted, 99);
+        result.max_us = sorted.back() / 1000.0;
+        result.mean_us = std::accumulate(sorted.begin(), sorted.end(), 0.0) / sorted.size() / 1000.0;
+        return result;
+    }
+
+    std::string to_json() {
+        std::ostringstream json;
+        json.setf(std::ios::fixed);
+        json.precision(3);
+        json << "{\n  \"benchmark\": \"" << escape(name) << "\",\n  \"properties\": {";
+        bool first = true;
+        for (auto& property : properties) {
+            json << (first ? "\n" : ",\n") << "    \"" << escape(property.first) << "\": \"" << escape(property.second) << "\"";
+            first = false;
+        }
+        json << "\n  },\n";
+        double seconds = wall_ns / 1e9;
+        json << "  \"frames\": " << frames << ",\n";
+        json << "  \"wall_s\": " << seconds << ",\n";
+        json << "  \"throughput_per_s\": " << (seconds > 0 ? frames / seconds : 0.0) << ",\n";
+        json << "  \"stages\": [";
+        first = true;
+        for (auto& stage : stage_order) {
+            LatencyStats s = stats(stage);
+            json << (first ? "\n" : ",\n") << "    { \"name\": \"" << escape(stage) << "\", \"count\": " << s.count
+                << ", \"min_us\": " << s.min_us << ", \"p50_us\": " << s.p50_us
+                << ", \"p90_us\": " << s.p90_us << ", \"p99_us\": " << s.p99_us
+                << ", \"max_us\": " << s.max_us << ", \"mean_us\": " << s.mean_us << " }";
+            first = false;
+        }
+        json << "\n  ]\n}\n";
+        return json.str();
+    }
+
+    bool write_json(const std::string& path) {
+        std::ofstream out(path, std::ios::trunc);
+        if (!out.is_open()) {
+            LOG_ERROR("Cannot write %s\n", path.c_str());
+            return false;
+        }
+        out << to_json();
+        return out.good();
+    }
+
+    void log() {
+        LOG_DEBUG("[%s] %-14s %8s %10s %10s %10s %10s %10s\n", name.c_str(), "stage", "count", "min us", "p50 us", "p90 us", "p99 us", "max us");
+        for (auto& stage : stage_order) {
+            LatencyStats s = stats(stage);
+            LOG_DEBUG("[%s] %-14s %8zu %10.1f %10.1f %10.1f %10.1f %10.1f\n", name.c_str(), stage.c_str(),
+                s.count, s.min_us, s.p50_us, s.p90_us, s.p99_us, s.max_us);
+        }
+    }
+};
+
+
+// Measures the enclosing scope into a BenchmarkReport stage (nullptr disables)
+class ScopedStageTimer {
+private:
+    BenchmarkReport* report;
+    const char* stage;
+    std::chrono::steady_clock::time_point begin;
+
+public:
+    ScopedStageTimer(BenchmarkReport* report, const char* stage)
+        : report{ report }, stage{ stage }, begin{ std::chrono::steady_clock::now() }
+    {
+
+    }
+
+    ~ScopedStageTimer() {
+        if (report)
+            report->add(stage, std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count());
+    }
+};
+
+
+/*
+* Replays a fixed video file or a directory of images, so pipeline numbers
+* do not depend on the camera or the scene. Wraps around at the end.
+*/
+class BenchmarkFrameSource {
+private:
+    cv::VideoCapture video;
+    std::vector<cv::String> files;
+    size_t next_file = 0;
+
+public:
+    bool open(const std::string& source) {
+        DWORD attributes = GetFileAttributesA(source.c_str());
+        if (attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY)) {
+            std::vector<cv::String> candidates;
+            cv::glob(source + "/*", candidates, false);
+            std::sort(candidates.begin(), candidates.end());
+            for (auto& file : candidates) {
+                std::string extension = file.substr(file.find_last_of('.') + 1);
+                std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+                if (extension == "png" || extension == "jpg" || extension == "jpeg" || extension == "bmp")
+                    files.push_back(file);
+            }
+            return !files.empty();
+        }
+        return video.open(source);
+    }
+
+    bool read(cv::Mat& frame) {
+        if (!files.empty()) {
+            frame = cv::imread(files[next_file], cv::ImreadModes::IMREAD_COLOR);
+            next_file = (next_file + 1) % files.size();
+            return !frame.empty();
+        }
+        if (!video.read(frame)) {
+            video.set(cv::CAP_PROP_POS_FRAMES, 0);
+            return video.read(frame);
+        }
+        return true;
+    }
+
+    void rewind() {
+        next_file = 0;
+        if (video.isOpened())
+            video.set(cv::CAP_PROP_POS_FRAMES, 0);
+    }
+};
@@ -0,0 +1,440 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+
+/*
+* Deferred logging backend. A call site stores a pointer to its static
+* LogSite (level and format string) and the raw argument values in a
+* fixed-size record of the calling thread's ring. Nothing is formatted or
+* allocated on the logging thread; a background thread drains the rings and
+* does the printf formatting. When a ring is full the message is dropped and
+* counted, logging never blocks. The drain sleeps while nothing is logged.
+*/
+struct LogSite {
+    const char* type;
+    const char* format;
+};
+
+enum class LogArgType : uint8_t { INT, UINT, DOUBLE, POINTER, STRING };
+
+struct LogRecord {
+    static const size_t MAX_ARGS = 16;
+    static const size_t PAYLOAD_SIZE = 200;
+
+    const LogSite* site;
+    uint8_t arg_count;
+    uint8_t size;       // payload bytes used
+    bool truncated;
+    LogArgType types[MAX_ARGS];
+    unsigned char payload[PAYLOAD_SIZE];
+};
+
+
+// Appends typed argument values to a record, strings are copied (truncated if needed)
+class LogRecordWriter {
+private:
+    LogRecord& record;
+
+    bool reserve(LogArgType type, size_t size) {
+        if (record.arg_count == LogRecord::MAX_ARGS || record.size + size > LogRecord::PAYLOAD_SIZE) {
+            record.truncated = true;
+            return false;
+        }
+        record.types[record.arg_count++] = type;
+        return true;
+    }
+
+    template <typename T>
+    void put_value(LogArgType type, T value) {
+        if (reserve(type, sizeof(T))) {
+            memcpy(record.payload + record.size, &value, sizeof(T));
+            record.size += sizeof(T);
+        }
+    }
+
+    void put_string(const char* text) {
+        if (!text)
+            text = "(null)";
+        size_t available = LogRecord::PAYLOAD_SIZE - record.size;
+        if (available < 2 || !reserve(LogArgType::STRING, 1)) {
+            record.truncated = true;
+            return;
+        }
+        size_t length = strnlen(text, std::min<size_t>(available - 1, 255));
+        record.payload[record.size] = (unsigned char)length;
+        memcpy(record.payload + record.size + 1, text, length);
+        record.size += (uint8_t)(1 + length);
+    }
+
+    template <typename T>
+    void put_pointer(T* value, std::true_type /* char */) {
+        put_string(value);
+    }
+
+    template <typename T>
+    void put_pointer(T* value, std::false_type) {
+        put_value(LogArgType::POINTER, (const void*)value);
+    }
+
+public:
+    LogRecordWriter(LogRecord& record) : record{ record } {
+        record.arg_count = 0;
+        record.size = 0;
+        record.truncated = false;
+    }
+
+    template <typename T>
+    typename std::enable_if<std::is_floating_point<T>::value>::type put(T value) {
+        put_value(LogArgType::DOUBLE, (double)value);
+    }
+
+    template <typename T>
+    typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value>::type put(T value) {
+        if (std::is_unsigned<T>::value)
+            put_value(LogArgType::UINT, (uint64_t)value);
+        else
+            put_value(LogArgType::INT, (int64_t)value);
+    }
+
+    template <typename T>
+    typename std::enable_if<std::is_pointer<T>::value>::type put(T value) {
+        put_pointer(value, std::is_same<typename std::remove_cv<typename std::remove_pointer<T>::type>::type, char>{});
+    }
+
+    void put(std::nullptr_t) {
+        put_value(LogArgType::POINTER, (const void*)nullptr);
+    }
+};
+
+
+// Single producer (the owning thread), single consumer (the drain)
+class LogRing {
+public:
+    static const uint64_t CAPACITY = 1024;
+
+private:
+    std::unique_ptr<LogRecord[]> records{ new LogRecord[CAPACITY] };
+    alignas(64) std::atomic<uint64_t> head{ 0 };
+    alignas(64) std::atomic<uint64_t> tail{ 0 };
+
+public:
+    std::atomic<uint64_t> dropped{ 0 };
+    std::atomic<bool> retired{ false }; // the owning thread exited, nothing is written anymore
+
+    LogRecord* claim() {
+        uint64_t index = head.load(std::memory_order_relaxed);
+        if (index - tail.load(std::memory_order_acquire) == CAPACITY) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        return &records[index % CAPACITY];
+    }
+
+    // True when the ring was empty before, the consumer may be asleep then
+    bool commit() {
+        uint64_t index = head.load(std::memory_order_relaxed);
+        head.store(index + 1, std::memory_order_release);
+        return index == tail.load(std::memory_order_acquire);
+    }
+
+    const LogRecord* front() {
+        uint64_t index = tail.load(std::memory_order_relaxed);
+        if (index == head.load(std::memory_order_acquire))
+            return nullptr;
+        return &records[index % CAPACITY];
+    }
+
+    void pop() {
+        tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+};
+
+
+class BinaryLogger {
+private:
+    struct LogArg {
+        LogArgType type;
+        int64_t i = 0;
+        uint64_t u = 0;
+        double d = 0;
+        const void* p = nullptr;
+        std::string s;
+    };
+
+    std::mutex mutex; // guards rings and serializes draining, never taken while logging
+    std::vector<std::unique_ptr<LogRing>> rings;
+    std::atomic<bool> stopping{ false };
+    std::thread drain_thread;
+    uint64_t reported_drops = 0;
+    uint64_t freed_ring_drops = 0;     // dropped by rings already freed
+
+    // The drain sleeps while the rings are empty, a ring turning non-empty wakes it
+    std::mutex wake_mutex;
+    std::condition_variable wake;
+    std::atomic<bool> sleeping{ false };
+    const std::chrono::milliseconds max_sleep{ 500 }; // fallback for a missed wake-up
+
+    BinaryLogger() {
+        drain_thread = std::thread(&BinaryLogger::drain_loop, this);
+    }
+
+    ~BinaryLogger() {
+        stopping = true;
+        {
+            std::lock_guard<std::mutex> lock(wake_mutex);
+            wake.notify_one();
+        }
+        if (drain_thread.joinable())
+            drain_thread.join();
+        flush();
+    }
+
+    LogRing* register_thread() {
+        std::lock_guard<std::mutex> lock(mutex);
+        rings.push_back(std::make_unique<LogRing>());
+        return rings.back().get();
+    }
+
+    // Retires the ring of an exiting thread, the drain frees it once it is empty
+    struct RingOwner {
+        LogRing*& ring;
+        bool& exited;
+
+        ~RingOwner() {
+            ring->retired.store(true, std::memory_order_release);
+            ring = nullptr;
+            exited = true;
+        }
+    };
+
+    // nullptr once the thread's thread_local destructors ran, the message is dropped then
+    LogRing* thread_ring() {
+        thread_local LogRing* ring = nullptr;
+        thread_local bool exited = false;
+        if (!ring && !exited) {
+            ring = register_thread();
+            thread_local RingOwner owner{ ring, exited };
+        }
+        return ring;
+    }
+
+    void drain_loop() {
+        while (!stopping) {
+            if (flush() > 0)
+                continue;
+            // records committed before sleeping was set did not wake anyone, look once more
+            sleeping = true;
+            if (flush() > 0) {
+                sleeping = false;
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(wake_mutex);
+            wake.wait_for(lock, max_sleep, [this]() { return !sleeping || stopping; });
+            sleeping = false;
+        }
+    }
+
+    // Only the first record after the drain went to sleep takes the wake mutex
+    void wake_drain() {
+        if (!sleeping.exchange(false))
+            return;
+        std::lock_guard<std::mutex> lock(wake_mutex);
+        wake.notify_one();
+    }
+
+    static std::vector<LogArg> decode(const LogRecord& record) {
+        std::vector<LogArg> args(record.arg_count);
+        size_t offset = 0;
+        for (size_t n = 0; n < record.arg_count; n++) {
+            LogArg& arg = args[n];
+            arg.type = record.types[n];
+            switch (arg.type) {
+            case LogArgType::INT:
+                memcpy(&arg.i, record.payload + offset, sizeof(int64_t));
+                offset += sizeof(int64_t);
+                arg.u = (uint64_t)arg.i;
+                arg.d = (double)arg.i;
+                break;
+            case LogArgType::UINT:
+                memcpy(&arg.u, record.payload + offset, sizeof(uint64_t));
+                offset += sizeof(uint64_t);
+                arg.i = (int64_t)arg.u;
+                arg.d = (double)arg.u;
+                break;
+            case LogArgType::DOUBLE:
+                memcpy(&arg.d, record.payload + offset, sizeof(double));
+                offset += sizeof(double);
+                arg.i = (int64_t)arg.d;
+                arg.u = (uint64_t)arg.i;
+                break;
+            case LogArgType::POINTER:
+                memcpy(&arg.p, record.payload + offset, sizeof(const void*));
+                offset += sizeof(const void*);
+                break;
+            case LogArgType::STRING:
+                arg.s.assign((const char*)record.payload + offset + 1, record.payload[offset]);
+                offset += 1 + record.payload[offset];
+                break;
+            }
+        }
+        return args;
+    }
+
+    /*
+    * printf formatting, one conversion at a time. Length modifiers in the
+    * format are ignored, the value is converted to what the conversion
+    * expects, so a mismatched argument prints wrongly but safely.
+    */
+    static std::string format(const LogRecord& record) {
+        std::vector<LogArg> args = decode(record);
+        std::string text = std::string("[") + record.site->type + "] ";
+        char buffer[512];
+        size_t next_arg = 0;
+
+        for (const char* f = record.site->format; *f; ) {
+            if (*f != '%') {
+                text += *f++;
+                continue;
+            }
+            if (f[1] == '%') {
+                text += '%';
+                f += 2;
+                continue;
+            }
+
+            const char* begin = f++;
+            while (*f && strchr("-+ #0123456789.", *f))
+                f++;
+            size_t prefix = f - begin;
+            while (*f && strchr("hlLzjtI64", *f))
+                f++;
+            char conversion = *f;
+            if (!conversion)
+                break;
+            f++;
+
+            if (next_arg >= args.size()) {
+                text += "(?)";
+                continue;
+            }
+            const LogArg& arg = args[next_arg++];
+            std::string spec(begin, prefix);
+            switch (conversion) {
+            case 'd': case 'i':
+                snprintf(buffer, sizeof(buffer), (spec + "lld").c_str(), (long long)arg.i);
+                break;
+            case 'u': case 'x': case 'X': case 'o':
+                snprintf(buffer, sizeof(buffer), (spec + "ll" + conversion).c_str(), (unsigned long long)arg.u);
+                break;
+            case 'c':
+                snprintf(buffer, sizeof(buffer), (spec + "c").c_str(), (int)arg.i);
+                break;
+            case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+                snprintf(buffer, sizeof(buffer), (spec + conversion).c_str(), arg.d);
+                break;
+            case 's':
+                snprintf(buffer, sizeof(buffer), (spec + "s").c_str(), arg.type == LogArgType::STRING ? arg.s.c_str() : "(?)");
+                break;
+            case 'p':
+                snprintf(buffer, sizeof(buffer), "%p", arg.p);
+                break;
+            default:
+                snprintf(buffer, sizeof(buffer), "(?)");
+                break;
+            }
+            text += buffer;
+        }
+
+        if (record.truncated)
+            text += " (truncated)\n";
+        return text;
+    }
+
+    static void emit(const std::string& text) {
+#ifdef _WIN32
+        OutputDebugStringA(text.c_str());
+#else
+        fputs(text.c_str(), stderr);
+#endif
+    }
+
+public:
+    static BinaryLogger& instance() {
+        static BinaryLogger logger;
+        return logger;
+    }
+
+    BinaryLogger(const BinaryLogger&) = delete;
+    BinaryLogger& operator=(const BinaryLogger&) = delete;
+
+    template <typename... Args>
+    void write(const LogSite* site, Args... args) {
+        LogRing* ring = thread_ring();
+        if (!ring)
+            return;
+        LogRecord* record = ring->claim();
+        if (!record)
+            return;
+        record->site = site;
+        LogRecordWriter writer(*record);
+        int expand[] = { 0, (writer.put(args), 0)... };
+        (void)expand;
+        if (ring->commit())
+            wake_drain();
+    }
+
+    // Formats and emits everything logged so far, returns the number of messages.
+    // Rings of exited threads are freed once drained.
+    size_t flush() {
+        std::lock_guard<std::mutex> lock(mutex);
+        size_t count = 0;
+        for (auto it = rings.begin(); it != rings.end(); ) {
+            LogRing& ring = **it;
+            // read before draining, every record of a retired ring is visible then
+            bool retired = ring.retired.load(std::memory_order_acquire);
+            while (const LogRecord* record = ring.front()) {
+                emit(format(*record));
+                ring.pop();
+                count++;
+            }
+            if (retired) {
+                freed_ring_drops += ring.dropped.load(std::memory_order_relaxed);
+                it = rings.erase(it);
+            }
+            else {
+                ++it;
+            }
+        }
+        uint64_t drops = freed_ring_drops;
+        for (auto& ring : rings) {
+            drops += ring->dropped.load(std::memory_order_relaxed);
+        }
+        if (drops > reported_drops) {
+            emit("[WARNING] " + std::to_string(drops - reported_drops) + " log messages dropped\n");
+            reported_drops = drops;
+        }
+        return count;
+    }
+};
+
+
+// One static LogSite per call site, its address identifies the format string
+#define BINARY_LOG(type, format, ...) do { \
+        static const LogSite log_site_{ type, format }; \
+        BinaryLogger::instance().write(&log_site_, ##__VA_ARGS__); \
+    } while (0)
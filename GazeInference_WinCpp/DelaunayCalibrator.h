@@ -6,6 +6,7 @@
 #include <vector>
 #include <fstream>
 #include "Calibrator.h"
+#include "Tracing.h"
 
 
 template <typename T>
@@ -49,6 +50,7 @@ public:
     }
 
     void add(cv::Point2f actualCoordinate, cv::Point2f predictedCoordinate, bool remap = true) override final {
+        TRACE_SCOPE("DelaunayCalibrator::add");
         // Convert to Delaunay Space
         if (remap) {
             actualCoordinate = InputToDelaunay(actualCoordinate);
@@ -64,6 +66,7 @@ public:
     }
 
     void add(std::vector<cv::Point2f> actualCoordinates, std::vector<cv::Point2f> predictedCoordinates, bool remap = true) override final {
+        TRACE_SCOPE("DelaunayCalibrator::add");
         // Convert to Delaunay Space
         if (remap) {
             actualCoordinates = InputToDelaunay(actualCoordinates);
@@ -81,6 +84,7 @@ public:
     }
 
     cv::Point2f evaluate(cv::Point2f searchPoint) override final {
+        TRACE_SCOPE("DelaunayCalibrator::evaluate");
         if (this->actual_coordinates.size() <= 3)
             return searchPoint;
 
@@ -0,0 +1,153 @@
+#pragma once
+#include "framework.h"
+#include "Metrics.h"
+#include <deque>
+
+struct DetectorPolicyConfig {
+    bool adaptive = true;
+    std::chrono::milliseconds probe_interval{ 2000 };   // between two probes, window searches included
+    double min_recall = 0.95;   // share of the reference detector's faces found
+    int min_probes = 10;        // probes before a detector's recall is trusted
+    int recall_window = 20;     // latest probes the recall is counted over
+    double smoothing = 0.1;     // weight of a new latency measurement
+};
+
+
+/*
+* Picks the face detector at runtime. The active detector's latency is
+* measured on every full-frame run. Every probe_interval, all detectors
+* process the same frame, which measures their latency and their recall
+* against the reference (UltraFace RFB, the most accurate one). The active
+* detector is kept until another one with a trusted recall is cheaper, or
+* its own trusted recall drops, which falls back to the reference.
+*/
+class DetectorPolicy {
+private:
+    static const int DETECTOR_COUNT = 3; // DETECTOR_TYPE values
+
+    struct Stats {
+        double latency_us = 0;
+        bool measured = false;
+        std::deque<bool> probes;    // found by the latest probes, oldest first
+        int hits = 0;
+        bool available = true;
+
+        double recall() const {
+            return probes.empty() ? 0 : (double)hits / probes.size();
+        }
+    };
+
+    DetectorPolicyConfig config;
+    Stats stats[DETECTOR_COUNT];
+    int active;
+    int reference;
+    std::chrono::steady_clock::time_point next_probe;
+
+    Gauge& active_gauge = MetricsRegistry::instance().gauge("detector.active");
+    Counter& switches = MetricsRegistry::instance().counter("detector.switches");
+
+    double type_recall(int type) const {
+        return type == reference ? 1.0 : stats[type].recall();
+    }
+
+    bool trusted(int type) const {
+        return (int)stats[type].probes.size() >= std::min(config.min_probes, config.recall_window);
+    }
+
+    // Available, with a trusted recall that holds up
+    bool eligible(int type) const {
+        if (type == reference)
+            return true;
+        return stats[type].available && stats[type].measured && trusted(type) && stats[type].recall() >= config.min_recall;
+    }
+
+    // Known to miss faces, or gone, an untrusted recall is not held against it
+    bool rejected(int type) const {
+        if (type == reference)
+            return false;
+        return !stats[type].available || (trusted(type) && stats[type].recall() < config.min_recall);
+    }
+
+public:
+    static const char* name(int type) {
+        static const char* names[DETECTOR_COUNT] = { "dlib-hog", "ultraface-rfb", "ultraface-slim" };
+        return names[type];
+    }
+
+    DetectorPolicy(int initial, int referenceType)
+        : active{ initial }, reference{ referenceType }
+    {
+        next_probe = std::chrono::steady_clock::now() + config.probe_interval;
+        active_gauge.set(active);
+    }
+
+    void configure(const DetectorPolicyConfig& policyConfig) {
+        config = policyConfig;
+        next_probe = std::chrono::steady_clock::now() + config.probe_interval;
+    }
+
+    bool adaptive() const {
+        return config.adaptive;
+    }
+
+    // A detector that could not be loaded is never probed or selected
+    void set_available(int type, bool available) {
+        stats[type].available = available;
+    }
+
+    bool available(int type) const {
+        return stats[type].available;
+    }
+
+    int active_detector() const {
+        return active;
+    }
+
+    int reference_detector() const {
+        return reference;
+    }
+
+    // True when this detection run should probe all detectors
+    bool probe_due() {
+        auto now = std::chrono::steady_clock::now();
+        if (!config.adaptive || !stats[reference].available || now < next_probe)
+            return false;
+        next_probe = now + config.probe_interval;
+        return true;
+    }
+
+    void record_latency(int type, double latency_us) {
+        Stats& s = stats[type];
+        s.latency_us = s.measured ? s.latency_us + config.smoothing * (latency_us - s.latency_us) : latency_us;
+        s.measured = true;
+    }
+
+    // Only for probes where the reference found a face
+    void record_probe(int type, bool found) {
+        Stats& s = stats[type];
+        s.probes.push_back(found);
+        s.hits += found;
+        while ((int)s.probes.size() > std::max(1, config.recall_window)) {
+            s.hits -= s.probes.front();
+            s.probes.pop_front();
+        }
+    }
+
+    // Switches to the cheapest eligible detector, returns the active one
+    int select() {
+        int best = rejected(active) ? reference : active;
+        for (int type = 0; type < DETECTOR_COUNT; type++) {
+            if (eligible(type) && stats[type].measured && stats[best].measured && stats[type].latency_us < stats[best].latency_us)
+                best = type;
+        }
+        if (best != active) {
+            LOG_DEBUG("Face detector %s (%.0f us, recall %.2f) -> %s (%.0f us, recall %.2f)\n",
+                name(active), stats[active].latency_us, type_recall(active),
+                name(best), stats[best].latency_us, type_recall(best));
+            active = best;
+            switches.add();
+            active_gauge.set(active);
+        }
+        return active;
+    }
+};
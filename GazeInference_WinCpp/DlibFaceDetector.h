@@ -6,6 +6,13 @@
 #include <dlib/gui_widgets.h>
 #include <dlib/image_io.h>
 #include "UltraFaceNet.h"
+#include "AssetBundle.h"
+#include "FlatShapePredictor.h"
+#include "SubjectTracker.h"
+#include "Tracing.h"
+#include "Metrics.h"
+#include "DetectorPolicy.h"
+#include "SearchWindow.h"
 
 template <typename T>
 std::vector<T> slice(std::vector<T> v, std::tuple<int, int> regionBounds)
@@ -32,6 +39,13 @@ enum DETECTOR_TYPE {DLIB, ULTRA_FACE, ULTRA_FACE_SLIM};
 enum BLURRING { LOW = 11, MEDIUM = 23, HIGH = 37 };
 enum NOISE { STATIC, SALT_PEPPER };
 
+// ROI images of one tracked face
+struct FaceROI {
+    int id;
+    cv::Rect face;                  // full resolution coordinates
+    std::vector<cv::Mat> roi_images;
+};
+
 cv::Scalar BLUE = cv::Scalar(255, 0, 0);
 cv::Scalar GREEN = cv::Scalar(0, 255, 0);
 cv::Scalar RED = cv::Scalar(0, 0, 255);
@@ -43,7 +57,11 @@ class DlibFaceDetector {
 private:
     dlib::frontal_face_detector detector;
     dlib::shape_predictor predictor;
+    FlatShapePredictor flat_predictor; // used instead of predictor when an asset bundle is set
+    std::shared_ptr<AssetBundle> bundle;
     std::string predictor_model_path = "assets/shape_predictor_68_face_landmarks.dat";
+    const wchar_t* ultra_face_model_path = L"assets/version-RFB-320_without_postprocessing.onnx";
+    const wchar_t* ultra_face_slim_model_path = L"assets/version-slim-320_without_postprocessing.onnx";
     std::map<std::string, std::tuple<int, int>> FACIAL_LANDMARKS_IDXS = { {"mouth", {48, 67}},
                                                                             {"inner_mouth", {60, 67}},
                                                                             {"right_eyebrow", {17, 21}},
@@ -61,26 +79,143 @@ private:
     
     int detector_type = DETECTOR_TYPE::ULTRA_FACE_SLIM;
     int frame_count = 0;
+    int detect_interval = SKIP_FRAMES;
     std::vector<dlib::rectangle> face_rectangles;
+    SubjectTracker subject_tracker;
     std::unique_ptr<UltraFaceNet> ultraFaceNet;
+    std::map<int, std::unique_ptr<UltraFaceNet>> standbyFaceNets; // the other variant, for the policy
+    DetectorPolicy policy{ detector_type, DETECTOR_TYPE::ULTRA_FACE };
+    SearchWindow search_window; // primary face only
+    std::shared_future<void> predictor_ready;
+    std::atomic<bool> predictor_loaded{ false };
+    cv::Rect primary_face; // landmark bounds of the last ROIExtraction
+    std::vector<cv::Point2f> primary_landmarks;
+
+    /* Metrics, hit rate is faces_found / frames */
+    Counter& frames_searched = MetricsRegistry::instance().counter("detector.frames");
+    Counter& faces_found = MetricsRegistry::instance().counter("detector.faces_found");  // frames with a face
+    Counter& faces_total = MetricsRegistry::instance().counter("detector.faces");          // faces over all frames
+    LatencyHistogram& roi_latency = MetricsRegistry::instance().histogram("detector.roi_extraction_us");
+    Counter& window_searches = MetricsRegistry::instance().counter("detector.window_searches");
+    Counter& full_sweeps = MetricsRegistry::instance().counter("detector.full_sweeps");
 
 public:
-    DlibFaceDetector() {
-        
+    // deferInit leaves init_detector()/init_predictor() to the caller,
+    // so both can run on separate startup threads
+    DlibFaceDetector(bool deferInit = false) {
+        if (deferInit)
+            return;
+
+        init_detector();
+
+        // initialize landmark detector in the background. The future is kept,
+        // dropping it would block right here until deserialization finishes.
+        predictor_ready = std::async(std::launch::async, &DlibFaceDetector::init_predictor, this).share();
+    }
+
+    ~DlibFaceDetector() {
+        // the background task writes into this object
+        if (predictor_ready.valid())
+            predictor_ready.wait();
+    }
+
+    // Asset bundle section names
+    static constexpr const char* ULTRA_FACE_SECTION = "ultraface-rfb-320";
+    static constexpr const char* ULTRA_FACE_SLIM_SECTION = "ultraface-slim-320";
+    static constexpr const char* PREDICTOR_SECTION = "shape-predictor-68";
+
+    // Adds the detector and landmark models to a bundle being built
+    void add_assets(AssetBundleWriter& writer) {
+        writer.add_file(ULTRA_FACE_SECTION, ASSET_KIND::ONNX_MODEL, ultra_face_model_path);
+        writer.add_file(ULTRA_FACE_SLIM_SECTION, ASSET_KIND::ONNX_MODEL, ultra_face_slim_model_path);
+
+        std::vector<char> flat;
+        if (FlatShapePredictor::flatten(predictor_model_path, flat))
+            writer.add_bytes(PREDICTOR_SECTION, ASSET_KIND::FLAT_SHAPE_PREDICTOR, std::move(flat),
+                std::wstring(predictor_model_path.begin(), predictor_model_path.end()));
+        else
+            LOG_WARN("Could not flatten %s\n", predictor_model_path.c_str());
+    }
+
+    // Load models from a mapped asset bundle, call before init_detector()/init_predictor()
+    void use_bundle(std::shared_ptr<AssetBundle> assetBundle) {
+        bundle = assetBundle;
+    }
+
+    std::unique_ptr<UltraFaceNet> load_ultra_face(int type) {
+        const char* section = (type == DETECTOR_TYPE::ULTRA_FACE) ? ULTRA_FACE_SECTION : ULTRA_FACE_SLIM_SECTION;
+        bool in_bundle = bundle && bundle->section(section);
+
+        if (in_bundle)
+            return std::make_unique<UltraFaceNet>(bundle, section);
+        else if (type == DETECTOR_TYPE::ULTRA_FACE)
+            return std::make_unique<UltraFaceNet>(ultra_face_model_path);
+        else
+            return std::make_unique<UltraFaceNet>(ultra_face_slim_model_path);
+    }
+
+    void init_detector() {
         // Initialize face detector
         if (detector_type == DETECTOR_TYPE::DLIB)
             detector = dlib::get_frontal_face_detector();
-        else if (detector_type == DETECTOR_TYPE::ULTRA_FACE)
-            ultraFaceNet = std::make_unique<UltraFaceNet>(L"assets/version-RFB-320_without_postprocessing.onnx");
-        else if (detector_type == DETECTOR_TYPE::ULTRA_FACE_SLIM)
-            ultraFaceNet = std::make_unique<UltraFaceNet>(L"assets/version-slim-320_without_postprocessing.onnx");
-            
-        // initialize landmark detector
-        std::async(&DlibFaceDetector::init_predictor, this);
+        else
+            ultraFaceNet = load_ultra_face(detector_type);
+
+        // The adaptive policy keeps every detector loaded, switching is instant
+        if (!policy.adaptive())
+            return;
+        if (detector_type != DETECTOR_TYPE::DLIB)
+            detector = dlib::get_frontal_face_detector();
+        for (int type : { DETECTOR_TYPE::ULTRA_FACE, DETECTOR_TYPE::ULTRA_FACE_SLIM }) {
+            if (type == detector_type)
+                continue;
+            try {
+                standbyFaceNets[type] = load_ultra_face(type);
+            }
+            catch (const Ort::Exception& e) {
+                LOG_WARN("Face detector %d not available: %s\n", type, e.what());
+                policy.set_available(type, false);
+            }
+        }
+    }
+
+    // Call before init_detector()
+    void configure_policy(const DetectorPolicyConfig& config) {
+        policy.configure(config);
+    }
+
+    int active_detector() const {
+        return policy.active_detector();
     }
 
     void init_predictor() {
-        dlib::deserialize(predictor_model_path) >> predictor;
+        AssetSection section;
+        if (bundle)
+            section = bundle->section(PREDICTOR_SECTION);
+
+        // The flat predictor is used in place from the mapping, no deserialization
+        if (!(section && flat_predictor.attach(section.data, section.size)))
+            dlib::deserialize(predictor_model_path) >> predictor;
+        predictor_loaded = true;
+    }
+
+    // 68 facial landmarks of the face inside rect, inputImage is BGR or luma (CV_8UC1)
+    std::vector<cv::Point2f> detect_landmarks(cv::Mat inputImage, dlib::rectangle rect) {
+        if (flat_predictor.is_attached())
+            return flat_predictor(inputImage, rect);
+
+        if (inputImage.channels() == 1) {
+            dlib::cv_image<unsigned char> inputImage_dlib(inputImage);
+            return shape_to_landmarks(predictor(inputImage_dlib, rect));
+        }
+        dlib::cv_image<dlib::bgr_pixel> inputImage_dlib(inputImage);
+        return shape_to_landmarks(predictor(inputImage_dlib, rect));
+    }
+
+    // Blocks until the landmark predictor is usable
+    void wait_until_ready() {
+        if (!predictor_loaded && predictor_ready.valid())
+            predictor_ready.wait();
     }
 
     std::vector<cv::Point2f> shape_to_landmarks(dlib::full_object_detection shape)
@@ -93,79 +228,152 @@ public:
         return parts;
     }
 
-    // TDODO: Instead of frame count use time difference to run face detector
-    // 30fps => 1000ms/30fps => 33ms
-    bool find_primary_face_dlib(cv::Mat inputImage, std::vector<cv::Point2f>& landmarks, cv::Size downscaling) {
-        bool is_valid = false;
+    // Faces found by one detector, in full resolution coordinates
+    std::vector<dlib::rectangle> run_detector(int type, cv::Mat inputImage, cv::Size downscaling) {
+        std::vector<dlib::rectangle> faces;
+        if (type == DETECTOR_TYPE::DLIB) {
+            // Downscale first, only the small image is converted to gray
+            cv::Mat downsampledImage;
+            cv::resize(inputImage, downsampledImage, cv::Size(), 1.0 / downscaling.width, 1.0 / downscaling.height);
+            cv::cvtColor(downsampledImage, downsampledImage, cv::COLOR_BGR2GRAY);
+            dlib::cv_image<unsigned char> downsampledImage_dlib(downsampledImage);
 
-        // Check for invalid input
-        if (!inputImage.data) {
-            LOG_ERROR("Image is empty.");
+            for (auto& rect : detector(downsampledImage_dlib)) {
+                faces.push_back(dlib::rectangle(
+                    (long)(rect.left() * downscaling.width),
+                    (long)(rect.top() * downscaling.height),
+                    (long)(rect.right() * downscaling.width),
+                    (long)(rect.bottom() * downscaling.height)));
+            }
         }
+        else {
+            cv::Mat inputImageRGB;
+            cv::cvtColor(inputImage, inputImageRGB, cv::ColorConversionCodes::COLOR_BGR2RGB);
+            UltraFaceNet* net = (type == detector_type) ? ultraFaceNet.get() : standbyFaceNets[type].get();
+            faces = net->detect_faces(inputImageRGB);
+        }
+        return faces;
+    }
 
-        // Convert mat to dlib's image format
-        dlib::cv_image<dlib::bgr_pixel> inputImage_dlib(inputImage);
+    std::vector<dlib::rectangle> timed_detect(int type, cv::Mat inputImage, cv::Size downscaling) {
+        auto begin = std::chrono::steady_clock::now();
+        std::vector<dlib::rectangle> faces = run_detector(type, inputImage, downscaling);
+        policy.record_latency(type, (double)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - begin).count());
+        return faces;
+    }
 
-        // Detect faces in every Kth (SKIP_FRAMES) frames
-        if (frame_count % SKIP_FRAMES == 0)
-        {
-            // Resize image for face detection
-            cv::Mat downsampledImage;
-            cv::cvtColor(inputImage, downsampledImage, cv::COLOR_BGR2GRAY);
-            cv::resize(downsampledImage, downsampledImage, cv::Size(), 1.0 / downscaling.width, 1.0 / downscaling.height);
-            dlib::cv_image<unsigned char> downsampledImage_dlib(downsampledImage);
+    /*
+    * Runs every available detector on the frame. Where the reference finds a
+    * face, each other detector scores a hit if one of its faces contains the
+    * center of the reference's first face. Returns the faces of the detector
+    * that is active afterwards.
+    */
+    std::vector<dlib::rectangle> probe_detectors(cv::Mat inputImage, cv::Size downscaling) {
+        TRACE_SCOPE("DlibFaceDetector::probe_detectors");
+        int reference = policy.reference_detector();
+        std::map<int, std::vector<dlib::rectangle>> results;
+        results[reference] = timed_detect(reference, inputImage, downscaling);
+        for (int type : { DETECTOR_TYPE::DLIB, DETECTOR_TYPE::ULTRA_FACE, DETECTOR_TYPE::ULTRA_FACE_SLIM }) {
+            if (type == reference || !policy.available(type))
+                continue;
+            results[type] = timed_detect(type, inputImage, downscaling);
+            if (results[reference].empty())
+                continue;
+            dlib::point center = dlib::center(results[reference][0]);
+            bool found = std::any_of(results[type].begin(), results[type].end(),
+                [&center](const dlib::rectangle& face) { return face.contains(center); });
+            policy.record_probe(type, found);
+        }
+        return results[policy.select()];
+    }
 
-            face_rectangles = detector(downsampledImage_dlib);
-            //frame_count = 0; //reset frame count 
+    /*
+    * Faces inside window, in frame coordinates. dlib scans the crop scaled so
+    * the face is about window_face_size wide, UltraFace resizes its input anyway.
+    * Not timed for the policy, which compares full-frame costs.
+    */
+    std::vector<dlib::rectangle> detect_in_window(int type, cv::Mat inputImage, cv::Rect window) {
+        cv::Mat crop = inputImage(window);
+        double scale = 1.0;
+        if (type == DETECTOR_TYPE::DLIB && search_window.scale() < 1.0) {
+            scale = search_window.scale();
+            cv::resize(crop, crop, cv::Size(), scale, scale, cv::INTER_AREA);
         }
-        frame_count++;
 
-        dlib::full_object_detection shape;
-        if (face_rectangles.size() == 1) {
-            is_valid = true;
-            dlib::rectangle rect(
-                (long)(face_rectangles[0].left() * downscaling.width),
-                (long)(face_rectangles[0].top() * downscaling.height),
-                (long)(face_rectangles[0].right() * downscaling.width),
-                (long)(face_rectangles[0].bottom() * downscaling.height)
-            );
-            shape = predictor(inputImage_dlib, rect);
-            landmarks = shape_to_landmarks(shape);
+        std::vector<dlib::rectangle> faces;
+        for (auto& face : run_detector(type, crop, cv::Size(1, 1))) {
+            faces.push_back(dlib::rectangle(
+                (long)(face.left() / scale) + window.x,
+                (long)(face.top() / scale) + window.y,
+                (long)(face.right() / scale) + window.x,
+                (long)(face.bottom() / scale) + window.y));
         }
-        return is_valid;
+        return faces;
     }
 
-    // https://github.com/Linzaer/Ultra-Light-Fast-Generic-Face-Detector-1MB
-    // inputImage is BGR
-    bool find_primary_face_ultraFace(cv::Mat inputImage, std::vector<cv::Point2f>& landmarks, cv::Size downscaling) {
-        bool is_valid = false;
+    static cv::Rect to_rect(const dlib::rectangle& face) {
+        return cv::Rect(cv::Point((int)face.left(), (int)face.top()), cv::Point((int)face.right() + 1, (int)face.bottom() + 1));
+    }
 
-        // Check for invalid input
-        if (!inputImage.data) {
-            LOG_ERROR("Image is empty.");
-        }
+    // True when the next detect_faces() runs a detector, otherwise it returns the last faces
+    bool detection_due() const {
+        return frame_count % detect_interval == 0;
+    }
 
-        cv::Mat inputImageRGB;
-        cv::cvtColor(inputImage, inputImageRGB, cv::ColorConversionCodes::COLOR_BGR2RGB);
-        // Detect faces in every Kth (SKIP_FRAMES) frames
-        if (frame_count % SKIP_FRAMES == 0)
+    // Every face of the frame in full resolution coordinates. Like the
+    // primary face path, detection only runs every Kth (SKIP_FRAMES) frame.
+    // primary searches the predicted window of the primary face first.
+    std::vector<dlib::rectangle> detect_faces(cv::Mat inputImage, cv::Size downscaling, bool primary = false) {
+        if (frame_count % detect_interval == 0)
         {
-            // image Resize is handled by ultraface internally 
-            face_rectangles = ultraFaceNet->detect_faces(inputImageRGB);
-            //frame_count = 0; //reset frame count 
+            // probes are timed, so they also come due while the window tracks the face
+            bool probe = policy.probe_due();
+            cv::Rect window = primary && !probe ? search_window.next(inputImage.size()) : cv::Rect();
+            if (window.area() > 0) {
+                face_rectangles = detect_in_window(policy.active_detector(), inputImage, window);
+                window_searches.add();
+            }
+            // sweep the frame when due or when the face left the window
+            if (window.area() == 0 || face_rectangles.empty()) {
+                if (probe)
+                    face_rectangles = probe_detectors(inputImage, downscaling);
+                else
+                    face_rectangles = timed_detect(policy.active_detector(), inputImage, downscaling);
+                full_sweeps.add();
+            }
+            if (primary) {
+                std::vector<cv::Rect> faces;
+                for (auto& face : face_rectangles) {
+                    faces.push_back(to_rect(face));
+                }
+                search_window.update(faces);
+            }
         }
         frame_count++;
+        return face_rectangles;
+    }
 
-        // Convert mat to dlib's image format
-        dlib::cv_image<dlib::bgr_pixel> inputImage_dlib(inputImage);
-        dlib::full_object_detection shape;
-        if (face_rectangles.size() == 1) {
-            is_valid = true;
-            dlib::rectangle rect = face_rectangles[0];
-            shape = predictor(inputImage_dlib, rect);
-            landmarks = shape_to_landmarks(shape);
+    // Primary face through the detector policy, landmarks only for a single face
+    bool find_primary_face(cv::Mat inputImage, std::vector<cv::Point2f>& landmarks, cv::Size downscaling) {
+        cv::Mat inputImageYCbCr;
+        return find_primary_face(inputImage, landmarks, downscaling, inputImageYCbCr);
+    }
+
+    // Same, and converts the frame to YCbCr once a single face is found. The
+    // landmarks run on its luma, so the ROI crops reuse the conversion.
+    bool find_primary_face(cv::Mat inputImage, std::vector<cv::Point2f>& landmarks, cv::Size downscaling, cv::Mat& inputImageYCbCr) {
+        // Check for invalid input
+        if (!inputImage.data) {
+            LOG_ERROR("Image is empty.");
         }
-        return is_valid;
+
+        std::vector<dlib::rectangle> faces = detect_faces(inputImage, downscaling, true);
+        if (faces.size() != 1)
+            return false;
+        cv::Mat luma;
+        inputImageYCbCr = cvtColor_BRG2YCbCr(inputImage, &luma);
+        landmarks = detect_landmarks(luma, faces[0]);
+        return true;
     }
 
     std::vector<dlib::full_object_detection> find_all_faces(cv::Mat inputImage) {
@@ -185,8 +393,11 @@ public:
         // To get all shapes
         std::vector<dlib::full_object_detection> shapes;
         for (unsigned long j = 0; j < face_rectangles.size(); ++j) {
-            dlib::full_object_detection shape = predictor(inputImage_dlib, face_rectangles[j]);
-            shapes.push_back(shape);
+            std::vector<dlib::point> parts;
+            for (auto& landmark : detect_landmarks(inputImage, face_rectangles[j])) {
+                parts.push_back(dlib::point((long)landmark.x, (long)landmark.y));
+            }
+            shapes.push_back(dlib::full_object_detection(face_rectangles[j], parts));
         }
         return shapes;
     }
@@ -242,8 +453,8 @@ public:
         cv::RotatedRect right_eye_rect = { {0, 0}, {0, 0}, 0 };
 
 
-        auto left_eye_shape_vector = slice(face_shape_vector, FACIAL_LANDMARKS_IDXS["left_eye"]);
-        auto right_eye_shape_vector = slice(face_shape_vector, FACIAL_LANDMARKS_IDXS["right_eye"]);
+        auto left_eye_shape_vector = slice(face_shape_vector, FACIAL_LANDMARKS_IDXS.at("left_eye"));
+        auto right_eye_shape_vector = slice(face_shape_vector, FACIAL_LANDMARKS_IDXS.at("right_eye"));
 
         face_rect = getSquareBoundingRect(face_shape_vector);
         left_eye_rect = cv::minAreaRect(left_eye_shape_vector);
@@ -272,8 +483,8 @@ public:
         cv::RotatedRect left_eye_rect = { {0, 0}, {0, 0}, 0 };//relative to face_rect
         cv::RotatedRect right_eye_rect = { {0, 0}, {0, 0}, 0 };//relative to face_rect
 
-        auto left_eye_shape_vector = slice(face_shape_vector, FACIAL_LANDMARKS_IDXS["left_eye"]);
-        auto right_eye_shape_vector = slice(face_shape_vector, FACIAL_LANDMARKS_IDXS["right_eye"]);
+        auto left_eye_shape_vector = slice(face_shape_vector, FACIAL_LANDMARKS_IDXS.at("left_eye"));
+        auto right_eye_shape_vector = slice(face_shape_vector, FACIAL_LANDMARKS_IDXS.at("right_eye"));
 
         // For face get a square boundingBox so that relative 
         // calibration of eye rects is valid for square cropped image 
@@ -394,24 +605,32 @@ public:
         cv::bitwise_or(webcamImage, blurMask, webcamImage);
     }
 
-    cv::Mat cvtColor_BRG2YCbCr(cv::Mat inputImageBGR) {
+    // luma, when given, gets the Y plane of the conversion (CV_8UC1)
+    cv::Mat cvtColor_BRG2YCbCr(cv::Mat inputImageBGR, cv::Mat* luma = nullptr) {
         cv::Mat inputImageYCrCb, inputImageYCbCr;
         cv::cvtColor(inputImageBGR, inputImageYCrCb, cv::ColorConversionCodes::COLOR_BGR2YCrCb);
         cv::Mat channels[3];
         cv::split(inputImageYCrCb, channels);
         std::swap(channels[1], channels[2]);
         cv::merge(channels, 3, inputImageYCbCr);
+        if (luma)
+            *luma = channels[0];
         return inputImageYCbCr;
     }
 
     void generate_face_eye_images(cv::Mat webcam_image, std::vector<cv::RotatedRect> rectangles, std::vector<cv::Mat>& roi_images) {
+        // Convert to YCbCr
+        cv::Mat inputImageYCbCr = cvtColor_BRG2YCbCr(webcam_image);
+        crop_face_eye_images(inputImageYCbCr, rectangles, roi_images);
+    }
+
+    // Same as generate_face_eye_images on an image already converted to YCbCr,
+    // so several faces can share one conversion
+    void crop_face_eye_images(cv::Mat inputImageYCbCr, const std::vector<cv::RotatedRect>& rectangles, std::vector<cv::Mat>& roi_images) {
         cv::RotatedRect face_rect = rectangles[0];
         cv::RotatedRect left_eye_rect = rectangles[1];
         cv::RotatedRect right_eye_rect = rectangles[2];
 
-        // Convert to YCbCr
-        cv::Mat inputImageYCbCr = cvtColor_BRG2YCbCr(webcam_image);
-
         cv::Mat face_image = crop_rect(inputImageYCbCr, face_rect);
         cv::Mat left_eye_image = crop_rect(inputImageYCbCr, left_eye_rect);
         cv::Mat right_eye_image = crop_rect(inputImageYCbCr, right_eye_rect);
@@ -569,23 +788,59 @@ public:
         }
     }
 
+    cv::Rect last_face() const {
+        return primary_face;
+    }
+
+    const std::vector<cv::Point2f>& last_landmarks() const {
+        return primary_landmarks;
+    }
+
+    // Detection runs on every Kth frame, the faces are reused in between
+    void set_detect_interval(int frames) {
+        detect_interval = std::max(1, frames);
+        reset_tracking();
+    }
+
+    int default_detect_interval() const {
+        return SKIP_FRAMES;
+    }
+
+    // The next frame runs detection, e.g. after the camera resolution changed
+    void reset_tracking() {
+        frame_count = 0;
+        face_rectangles.clear();
+        search_window.reset();
+    }
+
+    void configure_search_window(const SearchWindowConfig& config) {
+        search_window.configure(config);
+    }
+
     std::vector<cv::Mat> ROIExtraction(cv::Mat webcamImage, cv::Size downscaling) {
+        TRACE_SCOPE("DlibFaceDetector::ROIExtraction");
+        ScopedLatency latency(roi_latency);
+        frames_searched.add();
 
         // apply ROI extraction here
         std::vector<cv::Point2f> face_shape_vector;
         std::vector<cv::RotatedRect> rectangles;
         std::vector<cv::Mat> roi_images;
+        cv::Mat inputImageYCbCr;
         bool is_valid;
 
-        if (detector_type == DETECTOR_TYPE::DLIB)
-            is_valid = find_primary_face_dlib(webcamImage, face_shape_vector, downscaling);
-        else
-            is_valid = find_primary_face_ultraFace(webcamImage, face_shape_vector, downscaling);
+        wait_until_ready();
+
+        is_valid = find_primary_face(webcamImage, face_shape_vector, downscaling, inputImageYCbCr);
 
         if (is_valid) {
+            faces_found.add();
+            faces_total.add();
+            primary_face = cv::boundingRect(face_shape_vector);
+            primary_landmarks.assign(face_shape_vector.begin(), face_shape_vector.end());
             is_valid = landmarksToRects(face_shape_vector, rectangles);
             if (is_valid) {
-                generate_face_eye_images(webcamImage, rectangles, roi_images);
+                crop_face_eye_images(inputImageYCbCr, rectangles, roi_images);
                 resize_ROI_images(roi_images);
                 //show_ROI_extraction(webcamImage, face_shape_vector, rectangles, roi_images);
             }
@@ -611,5 +866,52 @@ public:
 
         return roi_images;
     }
+
+    // ROI images of every face in the frame, each with a stable subject id.
+    // The YCbCr conversion is shared, its luma feeds the landmarks, and the faces are processed in parallel.
+    std::vector<FaceROI> ROIExtractionAll(cv::Mat webcamImage, cv::Size downscaling) {
+        ScopedLatency latency(roi_latency);
+        frames_searched.add();
+        wait_until_ready();
+
+        std::vector<dlib::rectangle> faces = detect_faces(webcamImage, downscaling);
+        if (!faces.empty())
+            faces_found.add();
+        faces_total.add(faces.size());
+        std::vector<cv::Rect> face_rects;
+        for (auto& face : faces) {
+            face_rects.push_back(cv::Rect(cv::Point((int)face.left(), (int)face.top()),
+                cv::Point((int)face.right(), (int)face.bottom())));
+        }
+        std::vector<int> ids = subject_tracker.update(face_rects);
+        if (faces.empty())
+            return std::vector<FaceROI>();
+
+        cv::Mat luma;
+        cv::Mat inputImageYCbCr = cvtColor_BRG2YCbCr(webcamImage, &luma);
+
+        std::vector<FaceROI> rois(faces.size());
+        cv::parallel_for_(cv::Range(0, (int)faces.size()), [&](const cv::Range& range) {
+            for (int i = range.start; i < range.end; i++) {
+                std::vector<cv::RotatedRect> rectangles;
+                rois[i].id = ids[i];
+                rois[i].face = face_rects[i];
+                std::vector<cv::Point2f> face_shape_vector = detect_landmarks(luma, faces[i]);
+                if (!landmarksToRects(face_shape_vector, rectangles))
+                    continue;
+
+                crop_face_eye_images(inputImageYCbCr, rectangles, rois[i].roi_images);
+                resize_ROI_images(rois[i].roi_images);
+                for (auto& image : rois[i].roi_images) {
+                    image.convertTo(image, CV_32FC3, 1.0 / 255.0);
+                }
+            }
+        });
+
+        rois.erase(std::remove_if(rois.begin(), rois.end(), [](const FaceROI& roi) {
+            return roi.roi_images.size() != 4;
+        }), rois.end());
+        return rois;
+    }
 };
 
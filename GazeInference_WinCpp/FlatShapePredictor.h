@@ -0,0 +1,298 @@
+#pragma once
+#include "framework.h"
+#include <dlib/image_processing.h>
+#include <cstdint>
+
+
+/*
+* Flat, directly usable layout of a dlib shape_predictor (ERT cascade).
+*
+*   FlatShapePredictorHeader
+*   float      initial_shape[2 * num_parts]
+*   uint32_t   anchor_idx[num_cascades * num_features]
+*   float      deltas[num_cascades * num_features * 2]
+*   FlatSplit  splits[num_cascades * num_trees * num_splits]
+*   float      leaf_values[num_cascades * num_trees * num_leaves * 2 * num_parts]
+*
+* All arrays are 4-byte elements, so the layout can be used in place from a
+* mapped asset bundle section without deserialization.
+*/
+const uint32_t FLAT_SHAPE_PREDICTOR_MAGIC = 0x31505346; // "FSP1"
+
+#pragma pack(push, 1)
+struct FlatShapePredictorHeader {
+    uint32_t magic;
+    uint32_t num_parts;
+    uint32_t num_cascades;
+    uint32_t num_trees;     // per cascade
+    uint32_t num_splits;    // per tree (complete binary tree)
+    uint32_t num_leaves;    // per tree
+    uint32_t num_features;  // per cascade
+    uint32_t reserved;
+};
+
+struct FlatSplit {
+    uint32_t idx1;
+    uint32_t idx2;
+    float thresh;
+};
+#pragma pack(pop)
+
+
+class FlatShapePredictor {
+private:
+    const FlatShapePredictorHeader* header = nullptr;
+    const float* initial_shape = nullptr;
+    const uint32_t* anchor_idx = nullptr;
+    const float* deltas = nullptr;
+    const FlatSplit* splits = nullptr;
+    const float* leaf_values = nullptr;
+
+    static size_t expected_size(const FlatShapePredictorHeader& h) {
+        size_t features = (size_t)h.num_cascades * h.num_features;
+        size_t trees = (size_t)h.num_cascades * h.num_trees;
+        return sizeof(FlatShapePredictorHeader)
+            + sizeof(float) * 2 * h.num_parts
+            + sizeof(uint32_t) * features
+            + sizeof(float) * 2 * features
+            + sizeof(FlatSplit) * trees * h.num_splits
+            + sizeof(float) * trees * h.num_leaves * 2 * h.num_parts;
+    }
+
+    // Same intensity definition as dlib::get_pixel_intensity
+    static float pixel_intensity(const cv::Mat& image, int x, int y) {
+        const uchar* row = image.ptr<uchar>(y);
+        if (image.channels() == 1)
+            return row[x];
+        const uchar* pixel = row + 3 * x;
+        return (float)((pixel[0] + pixel[1] + pixel[2]) / 3);
+    }
+
+    // 2x2 part of the least squares similarity transform reference -> current
+    // (closed form of dlib::find_similarity_transform for 2D points)
+    void similarity_transform(const float* from, const float* to, float M[4]) const {
+        const uint32_t n = header->num_parts;
+        float from_mx = 0, from_my = 0, to_mx = 0, to_my = 0;
+        for (uint32_t i = 0; i < n; i++) {
+            from_mx += from[2 * i]; from_my += from[2 * i + 1];
+            to_mx += to[2 * i]; to_my += to[2 * i + 1];
+        }
+        from_mx /= n; from_my /= n; to_mx /= n; to_my /= n;
+
+        float norm = 0, a = 0, b = 0;
+        for (uint32_t i = 0; i < n; i++) {
+            float fx = from[2 * i] - from_mx, fy = from[2 * i + 1] - from_my;
+            float tx = to[2 * i] - to_mx, ty = to[2 * i + 1] - to_my;
+            norm += fx * fx + fy * fy;
+            a += fx * tx + fy * ty;
+            b += fx * ty - fy * tx;
+        }
+        if (norm > 0) {
+            a /= norm;
+            b /= norm;
+        }
+        else {
+            a = 1;
+            b = 0;
+        }
+        M[0] = a; M[1] = -b;
+        M[2] = b; M[3] = a;
+    }
+
+public:
+    FlatShapePredictor() {}
+
+    bool attach(const void* data, size_t size) {
+        header = nullptr;
+        if (size < sizeof(FlatShapePredictorHeader))
+            return false;
+
+        const FlatShapePredictorHeader* candidate = static_cast<const FlatShapePredictorHeader*>(data);
+        if (candidate->magic != FLAT_SHAPE_PREDICTOR_MAGIC
+            || candidate->num_leaves != candidate->num_splits + 1
+            || expected_size(*candidate) != size) {
+            LOG_ERROR("Invalid flat shape predictor.\n");
+            return false;
+        }
+
+        header = candidate;
+        const uint8_t* cursor = static_cast<const uint8_t*>(data) + sizeof(FlatShapePredictorHeader);
+        size_t features = (size_t)header->num_cascades * header->num_features;
+        size_t trees = (size_t)header->num_cascades * header->num_trees;
+
+        initial_shape = reinterpret_cast<const float*>(cursor);
+        cursor += sizeof(float) * 2 * header->num_parts;
+        anchor_idx = reinterpret_cast<const uint32_t*>(cursor);
+        cursor += sizeof(uint32_t) * features;
+        deltas = reinterpret_cast<const float*>(cursor);
+        cursor += sizeof(float) * 2 * features;
+        splits = reinterpret_cast<const FlatSplit*>(cursor);
+        cursor += sizeof(FlatSplit) * trees * header->num_splits;
+        leaf_values = reinterpret_cast<const float*>(cursor);
+        return true;
+    }
+
+    bool is_attached() const {
+        return header != nullptr;
+    }
+
+    size_t num_parts() const {
+        return header ? header->num_parts : 0;
+    }
+
+    // image is BGR (CV_8UC3) or intensity (CV_8UC1), mirrors shape_predictor::operator()
+    // Thread-safe, the mapped model is only read
+    std::vector<cv::Point2f> operator()(const cv::Mat& image, const dlib::rectangle& rect) const {
+        const uint32_t parts = header->num_parts;
+        std::vector<float> current_shape(initial_shape, initial_shape + 2 * parts);
+        std::vector<float> feature_values(header->num_features);
+
+        // normalized [0,1] shape space -> image
+        const float left = (float)rect.left(), top = (float)rect.top();
+        const float width = (float)(rect.right() - rect.left());
+        const float height = (float)(rect.bottom() - rect.top());
+
+        const size_t split_stride = header->num_splits;
+        const size_t leaf_stride = (size_t)header->num_leaves * 2 * parts;
+
+        for (uint32_t cascade = 0; cascade < header->num_cascades; cascade++) {
+            float M[4];
+            similarity_transform(initial_shape, current_shape.data(), M);
+
+            const uint32_t* anchors = anchor_idx + (size_t)cascade * header->num_features;
+            const float* cascade_deltas = deltas + (size_t)cascade * header->num_features * 2;
+            for (uint32_t f = 0; f < header->num_features; f++) {
+                float dx = cascade_deltas[2 * f], dy = cascade_deltas[2 * f + 1];
+                uint32_t anchor = anchors[f];
+                float sx = M[0] * dx + M[1] * dy + current_shape[2 * anchor];
+                float sy = M[2] * dx + M[3] * dy + current_shape[2 * anchor + 1];
+                int x = (int)std::floor(left + sx * width + 0.5f);
+                int y = (int)std::floor(top + sy * height + 0.5f);
+                if (x >= 0 && y >= 0 && x < image.cols && y < image.rows)
+                    feature_values[f] = pixel_intensity(image, x, y);
+                else
+                    feature_values[f] = 0;
+            }
+
+            for (uint32_t tree = 0; tree < header->num_trees; tree++) {
+                size_t tree_index = (size_t)cascade * header->num_trees + tree;
+                const FlatSplit* tree_splits = splits + tree_index * split_stride;
+
+                uint32_t node = 0;
+                while (node < header->num_splits) {
+                    const FlatSplit& split = tree_splits[node];
+                    if (feature_values[split.idx1] - feature_values[split.idx2] > split.thresh)
+                        node = 2 * node + 1; // left child
+                    else
+                        node = 2 * node + 2; // right child
+                }
+
+                const float* leaf = leaf_values + tree_index * leaf_stride + (size_t)(node - header->num_splits) * 2 * parts;
+                for (uint32_t i = 0; i < 2 * parts; i++) {
+                    current_shape[i] += leaf[i];
+                }
+            }
+        }
+
+        std::vector<cv::Point2f> landmarks(parts);
+        for (uint32_t i = 0; i < parts; i++) {
+            // dlib rounds the parts to integer pixels
+            landmarks[i] = cv::Point2f(std::floor(left + current_shape[2 * i] * width + 0.5f),
+                std::floor(top + current_shape[2 * i + 1] * height + 0.5f));
+        }
+        return landmarks;
+    }
+
+    // Converts a serialized dlib shape_predictor (.dat) into the flat layout
+    static bool flatten(const std::string& predictor_path, std::vector<char>& flat) {
+        std::ifstream in(predictor_path, std::ios::binary);
+        if (!in.is_open())
+            return false;
+
+        // Same field order as dlib's serialize(const shape_predictor&)
+        int version = 0;
+        dlib::matrix<float, 0, 1> initial;
+        std::vector<std::vector<dlib::impl::regression_tree>> forests;
+        std::vector<std::vector<unsigned long>> anchors;
+        std::vector<std::vector<dlib::vector<float, 2>>> pixel_deltas;
+        try {
+            dlib::deserialize(version, in);
+            if (version != 1)
+                return false;
+            dlib::deserialize(initial, in);
+            dlib::deserialize(forests, in);
+            dlib::deserialize(anchors, in);
+            dlib::deserialize(pixel_deltas, in);
+        }
+        catch (dlib::serialization_error& e) {
+            LOG_ERROR("%s", e.what());
+            return false;
+        }
+        if (forests.empty() || forests[0].empty() || anchors.size() != forests.size() || pixel_deltas.size() != forests.size())
+            return false;
+
+        FlatShapePredictorHeader h;
+        h.magic = FLAT_SHAPE_PREDICTOR_MAGIC;
+        h.num_parts = (uint32_t)(initial.size() / 2);
+        h.num_cascades = (uint32_t)forests.size();
+        h.num_trees = (uint32_t)forests[0].size();
+        h.num_splits = (uint32_t)forests[0][0].splits.size();
+        h.num_leaves = (uint32_t)forests[0][0].leaf_values.size();
+        h.num_features = (uint32_t)anchors[0].size();
+        h.reserved = 0;
+
+        // The flat layout needs a uniform cascade (dlib trains it that way)
+        for (size_t c = 0; c < forests.size(); c++) {
+            if (forests[c].size() != h.num_trees || anchors[c].size() != h.num_features || pixel_deltas[c].size() != h.num_features)
+                return false;
+            for (auto& tree : forests[c]) {
+                if (tree.splits.size() != h.num_splits || tree.leaf_values.size() != h.num_leaves)
+                    return false;
+            }
+        }
+
+        flat.clear();
+        flat.reserve(expected_size(h));
+        auto append = [&flat](const void* data, size_t size) {
+            const char* bytes = static_cast<const char*>(data);
+            flat.insert(flat.end(), bytes, bytes + size);
+        };
+
+        append(&h, sizeof(h));
+        for (long i = 0; i < initial.size(); i++) {
+            float value = initial(i);
+            append(&value, sizeof(value));
+        }
+        for (auto& cascade : anchors) {
+            for (unsigned long anchor : cascade) {
+                uint32_t value = (uint32_t)anchor;
+                append(&value, sizeof(value));
+            }
+        }
+        for (auto& cascade : pixel_deltas) {
+            for (auto& delta : cascade) {
+                float value[2] = { delta.x(), delta.y() };
+                append(value, sizeof(value));
+            }
+        }
+        for (auto& cascade : forests) {
+            for (auto& tree : cascade) {
+                for (auto& split : tree.splits) {
+                    FlatSplit value = { (uint32_t)split.idx1, (uint32_t)split.idx2, split.thresh };
+                    append(&value, sizeof(value));
+                }
+            }
+        }
+        for (auto& cascade : forests) {
+            for (auto& tree : cascade) {
+                for (auto& leaf : tree.leaf_values) {
+                    for (long i = 0; i < leaf.size(); i++) {
+                        float value = leaf(i);
+                        append(&value, sizeof(value));
+                    }
+                }
+            }
+        }
+        return flat.size() == expected_size(h);
+    }
+};
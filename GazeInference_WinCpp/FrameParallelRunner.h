@@ -0,0 +1,180 @@
+#pragma once
+#include "framework.h"
+#include "Model.h"
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+
+
+/*
+* Releases results in sequence-number order, whatever order the workers
+* finish them in. Every sequence number must be pushed exactly once.
+*/
+template <typename T>
+class ReorderBuffer {
+private:
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::map<uint64_t, T> pending;
+    uint64_t next_sequence = 0;
+    bool closed = false;
+
+public:
+    void push(uint64_t sequence, T value) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pending.emplace(sequence, std::move(value));
+        }
+        ready.notify_all();
+    }
+
+    // Blocks until the next result in order is available, false once closed
+    bool pop(T& value) {
+        std::unique_lock<std::mutex> lock(mutex);
+        ready.wait(lock, [this]() { return closed || (!pending.empty() && pending.begin()->first == next_sequence); });
+        if (pending.empty() || pending.begin()->first != next_sequence)
+            return false;
+
+        value = std::move(pending.begin()->second);
+        pending.erase(pending.begin());
+        next_sequence++;
+        return true;
+    }
+
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closed = true;
+        }
+        ready.notify_all();
+    }
+
+    size_t size() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return pending.size();
+    }
+};
+
+
+struct FrameResult {
+    uint64_t sequence;
+    bool is_valid;
+    std::vector<Output> outputs;
+};
+
+
+/*
+* K session replicas of the same model process consecutive frames
+* concurrently. submit() hands out sequence numbers in capture order and
+* next() returns the results in that same order through a ReorderBuffer.
+* Each replica gets intraOpThreads, so K * intraOpThreads should not exceed
+* the physical cores.
+*/
+class FrameParallelRunner {
+private:
+    struct FrameJob {
+        uint64_t sequence;
+        std::vector<cv::Mat> frames;
+        std::chrono::steady_clock::time_point deadline;
+    };
+
+    std::vector<std::unique_ptr<Model>> replicas;
+    std::vector<std::thread> workers;
+    ReorderBuffer<FrameResult> reorder_buffer;
+
+    std::mutex mutex;
+    std::condition_variable queue_changed;
+    std::deque<FrameJob> jobs;
+    size_t max_pending;
+    uint64_t next_sequence = 0;
+    bool stopping = false;
+
+    void work(Model* replica) {
+        while (true) {
+            FrameJob job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                queue_changed.wait(lock, [this]() { return stopping || !jobs.empty(); });
+                if (jobs.empty())
+                    return; // stopping
+                job = std::move(jobs.front());
+                jobs.pop_front();
+            }
+            queue_changed.notify_all(); // room for the producer
+
+            FrameResult result;
+            result.sequence = job.sequence;
+            // frames already past their deadline are not run, overrunning runs are terminated
+            result.is_valid = std::chrono::steady_clock::now() <= job.deadline;
+            if (result.is_valid) {
+                replica->preprocessedFrames = std::move(job.frames);
+                replica->fillInputTensor();
+                result.is_valid = replica->run(job.deadline);
+                result.outputs = replica->outputs;
+                result.is_valid = result.is_valid && !result.outputs.empty() && !result.outputs[0].values.empty();
+            }
+            reorder_buffer.push(result.sequence, std::move(result));
+        }
+    }
+
+public:
+    FrameParallelRunner(const wchar_t* modelFilePath, int replicaCount, int intraOpThreads, std::shared_ptr<AssetBundle> bundle = nullptr, const std::string& section = "")
+        : max_pending{ 2 * (size_t)std::max(1, replicaCount) }
+    {
+        for (int k = 0; k < std::max(1, replicaCount); k++) {
+            auto replica = std::make_unique<Model>(modelFilePath, true);
+            if (bundle)
+                replica->useAssetBundle(bundle, section);
+            replica->setThreadCounts(intraOpThreads, 1);
+            replica->load();
+            replicas.push_back(std::move(replica));
+        }
+        for (auto& replica : replicas) {
+            workers.push_back(std::thread(&FrameParallelRunner::work, this, replica.get()));
+        }
+    }
+
+    ~FrameParallelRunner() {
+        close();
+    }
+
+    // Finishes the queued frames, then next() returns false once their results are taken
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        queue_changed.notify_all();
+        for (auto& worker : workers) {
+            if (worker.joinable())
+                worker.join();
+        }
+        reorder_buffer.close();
+    }
+
+    FrameParallelRunner(const FrameParallelRunner&) = delete;
+    FrameParallelRunner& operator=(const FrameParallelRunner&) = delete;
+
+    // Queues a preprocessed frame, blocks while max_pending frames are in flight.
+    // The result of a frame not inferred by deadline is invalid.
+    uint64_t submit(std::vector<cv::Mat> frames,
+        std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max()) {
+        std::unique_lock<std::mutex> lock(mutex);
+        queue_changed.wait(lock, [this]() { return stopping || jobs.size() < max_pending; });
+        uint64_t sequence = next_sequence++;
+        jobs.push_back({ sequence, std::move(frames), deadline });
+        lock.unlock();
+        queue_changed.notify_all();
+        return sequence;
+    }
+
+    // Next result in capture order
+    bool next(FrameResult& result) {
+        return reorder_buffer.pop(result);
+    }
+
+    size_t replica_count() const {
+        return replicas.size();
+    }
+};
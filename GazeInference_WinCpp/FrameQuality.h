@@ -0,0 +1,88 @@
+#pragma once
+#include "framework.h"
+#include "Metrics.h"
+
+struct FrameQualityConfig {
+    bool enabled = true;
+    double min_eye_aspect_ratio = 0.18; // mean of both eyes, open eyes are around 0.3
+    double min_sharpness = 1e-4;        // Laplacian variance of the eye luma (0..1)
+};
+
+struct FrameQualityScore {
+    double eye_aspect_ratio = 0;
+    double sharpness = 0;
+    bool blink = false;
+    bool blurred = false;
+
+    bool accepted() const {
+        return !blink && !blurred;
+    }
+};
+
+
+/*
+* Rejects frames that would give garbage gaze: blinks, detected from the eye
+* aspect ratio of the 68 landmarks (Soukupova and Cech, 2016), and motion
+* blur, from the variance of the Laplacian of the eye crops. Both reuse what
+* ROI extraction already produced.
+*/
+class FrameQuality {
+private:
+    FrameQualityConfig config;
+    cv::Mat luma, laplacian;
+
+    Counter& blinks = MetricsRegistry::instance().counter("quality.blinks");
+    Counter& blurred = MetricsRegistry::instance().counter("quality.blurred");
+
+    // 68-landmark eye contours, six points each starting at the outer corner
+    static const int RIGHT_EYE_FIRST = 36;
+    static const int LEFT_EYE_FIRST = 42;
+
+public:
+    FrameQuality() {}
+
+    void configure(const FrameQualityConfig& qualityConfig) {
+        config = qualityConfig;
+    }
+
+    bool enabled() const {
+        return config.enabled;
+    }
+
+    // (|p2 - p6| + |p3 - p5|) / (2 |p1 - p4|), drops towards 0 as the eye closes
+    static double eye_aspect_ratio(const std::vector<cv::Point2f>& landmarks, int first) {
+        const cv::Point2f* p = &landmarks[first];
+        double width = cv::norm(p[0] - p[3]);
+        if (width <= 0)
+            return 0;
+        return (cv::norm(p[1] - p[5]) + cv::norm(p[2] - p[4])) / (2 * width);
+    }
+
+    // roi is a HWC float YCbCr crop, luma is channel 0
+    double sharpness(const cv::Mat& roi) {
+        cv::extractChannel(roi, luma, 0);
+        cv::Laplacian(luma, laplacian, CV_32F);
+        cv::Scalar mean, stddev;
+        cv::meanStdDev(laplacian, mean, stddev);
+        return stddev[0] * stddev[0];
+    }
+
+    // roi_images in ROIExtraction order (face, left eye, right eye, face grid)
+    FrameQualityScore assess(const std::vector<cv::Mat>& roi_images, const std::vector<cv::Point2f>& landmarks) {
+        FrameQualityScore score;
+        if (landmarks.size() >= 48) {
+            score.eye_aspect_ratio = 0.5 * (eye_aspect_ratio(landmarks, RIGHT_EYE_FIRST) + eye_aspect_ratio(landmarks, LEFT_EYE_FIRST));
+            score.blink = score.eye_aspect_ratio < config.min_eye_aspect_ratio;
+        }
+        if (!score.blink && roi_images.size() >= 3) {
+            score.sharpness = std::min(sharpness(roi_images[1]), sharpness(roi_images[2]));
+            score.blurred = score.sharpness < config.min_sharpness;
+        }
+
+        if (score.blink)
+            blinks.add();
+        else if (score.blurred)
+            blurred.add();
+        return score;
+    }
+};
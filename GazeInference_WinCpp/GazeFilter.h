@@ -0,0 +1,190 @@
+#pragma once
+#include "framework.h"
+
+enum FILTER_TYPE { NO_FILTER, ONE_EURO, KALMAN };
+
+struct GazeFilterConfig {
+    int type = FILTER_TYPE::ONE_EURO;
+    bool extrapolate = true;            // predict to the publish time
+    double max_prediction_s = 0.1;      // longer horizons overshoot saccades
+
+    // One-Euro, in normalized screen units (0..1) per second
+    double min_cutoff_hz = 1.0;
+    double beta = 10.0;
+    double derivative_cutoff_hz = 1.0;
+
+    // Constant-velocity Kalman
+    double acceleration_noise = 20.0;   // process noise spectral density
+    double measurement_noise = 1e-3;    // variance of a raw point
+};
+
+
+/*
+* Streaming smoother for calibrated gaze points. update() takes a point with
+* its capture time, predict() extrapolates the filtered position to a later
+* time. Both are O(1) and do not allocate.
+*/
+class GazeFilter {
+protected:
+    bool initialized = false;
+    double last_time_s = 0;
+
+public:
+    GazeFilter() {}
+    virtual ~GazeFilter() {}
+
+    virtual void update(cv::Point2f measurement, double time_s) = 0;
+    virtual cv::Point2f position() const = 0;
+    virtual cv::Point2f velocity() const = 0;
+
+    virtual void reset() {
+        initialized = false;
+    }
+
+    cv::Point2f predict(double time_s, double max_horizon_s) const {
+        double horizon = std::min(std::max(0.0, time_s - last_time_s), max_horizon_s);
+        return position() + velocity() * (float)horizon;
+    }
+};
+
+
+// Passes points through, the velocity is the last finite difference
+class NoGazeFilter : public GazeFilter {
+private:
+    cv::Point2f current;
+    cv::Point2f rate;
+
+public:
+    void update(cv::Point2f measurement, double time_s) override final {
+        double dt = time_s - last_time_s;
+        rate = (initialized && dt > 0) ? (measurement - current) * (float)(1.0 / dt) : cv::Point2f();
+        current = measurement;
+        last_time_s = time_s;
+        initialized = true;
+    }
+
+    cv::Point2f position() const override final { return current; }
+    cv::Point2f velocity() const override final { return rate; }
+};
+
+
+/*
+* One-Euro filter (Casiez et al., CHI 2012): a low-pass whose cutoff rises
+* with speed, so fixations are smooth and saccades lag little.
+*/
+class OneEuroGazeFilter : public GazeFilter {
+private:
+    double min_cutoff_hz;
+    double beta;
+    double derivative_cutoff_hz;
+    cv::Point2f current;
+    cv::Point2f rate;
+
+    static double alpha(double cutoff_hz, double dt) {
+        double tau = 1.0 / (2 * CV_PI * cutoff_hz);
+        return 1.0 / (1.0 + tau / dt);
+    }
+
+public:
+    OneEuroGazeFilter(double min_cutoff_hz, double beta, double derivative_cutoff_hz)
+        : min_cutoff_hz{ min_cutoff_hz }, beta{ beta }, derivative_cutoff_hz{ derivative_cutoff_hz }
+    {
+
+    }
+
+    void update(cv::Point2f measurement, double time_s) override final {
+        double dt = time_s - last_time_s;
+        if (!initialized || dt <= 0) {
+            if (!initialized) {
+                current = measurement;
+                rate = cv::Point2f();
+                last_time_s = time_s;
+                initialized = true;
+            }
+            return;
+        }
+
+        cv::Point2f raw_rate = (measurement - current) * (float)(1.0 / dt);
+        rate += (raw_rate - rate) * (float)alpha(derivative_cutoff_hz, dt);
+        double cutoff = min_cutoff_hz + beta * cv::norm(rate);
+        current += (measurement - current) * (float)alpha(cutoff, dt);
+        last_time_s = time_s;
+    }
+
+    cv::Point2f position() const override final { return current; }
+    cv::Point2f velocity() const override final { return rate; }
+};
+
+
+/*
+* Constant-velocity Kalman filter, x and y are independent [position, velocity]
+* states with white-acceleration process noise.
+*/
+class KalmanGazeFilter : public GazeFilter {
+private:
+    struct Axis {
+        double p = 0, v = 0;                // state
+        double pp = 1, pv = 0, vv = 1;      // covariance
+
+        void predict(double dt, double q) {
+            p += v * dt;
+            pp += dt * (2 * pv + dt * vv) + q * dt * dt * dt / 3;
+            pv += dt * vv + q * dt * dt / 2;
+            vv += q * dt;
+        }
+
+        void correct(double z, double r) {
+            double s = pp + r;
+            double kp = pp / s, kv = pv / s;
+            double innovation = z - p;
+            p += kp * innovation;
+            v += kv * innovation;
+            vv -= kv * pv;
+            pv -= kv * pp;
+            pp -= kp * pp;
+        }
+    };
+
+    double acceleration_noise;
+    double measurement_noise;
+    Axis x, y;
+
+public:
+    KalmanGazeFilter(double acceleration_noise, double measurement_noise)
+        : acceleration_noise{ acceleration_noise }, measurement_noise{ measurement_noise }
+    {
+
+    }
+
+    void update(cv::Point2f measurement, double time_s) override final {
+        if (!initialized) {
+            x = Axis();
+            y = Axis();
+            x.p = measurement.x;
+            y.p = measurement.y;
+            x.pp = y.pp = measurement_noise;
+            last_time_s = time_s;
+            initialized = true;
+            return;
+        }
+
+        double dt = std::max(0.0, time_s - last_time_s);
+        x.predict(dt, acceleration_noise);
+        y.predict(dt, acceleration_noise);
+        x.correct(measurement.x, measurement_noise);
+        y.correct(measurement.y, measurement_noise);
+        last_time_s = std::max(last_time_s, time_s);
+    }
+
+    cv::Point2f position() const override final { return cv::Point2f((float)x.p, (float)y.p); }
+    cv::Point2f velocity() const override final { return cv::Point2f((float)x.v, (float)y.v); }
+};
+
+
+inline std::unique_ptr<GazeFilter> createGazeFilter(const GazeFilterConfig& config) {
+    if (config.type == FILTER_TYPE::ONE_EURO)
+        return std::make_unique<OneEuroGazeFilter>(config.min_cutoff_hz, config.beta, config.derivative_cutoff_hz);
+    if (config.type == FILTER_TYPE::KALMAN)
+        return std::make_unique<KalmanGazeFilter>(config.acceleration_noise, config.measurement_noise);
+    return std::make_unique<NoGazeFilter>();
+}
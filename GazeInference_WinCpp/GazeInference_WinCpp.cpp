@@ -5,6 +5,7 @@
 #include "GazeInference_WinCpp.h"
 #include "FrameCapture.h"
 #include "ITrackerModel.h"
+#include "Microbenchmarks.h"
 #include "SqueezeNet.h"
 #include "UltraFaceNet.h"
 
@@ -30,10 +31,24 @@ const wchar_t* modelFilepath = L"assets/itracker.onnx";
 
 const wchar_t* labelFilepath = NULL;
 std::unique_ptr<ITrackerModel> model;
+std::unique_ptr<MetricsExporter> metricsExporter;
+GazeFilterConfig gazeFilterConfig;
+double outputRateHz = 0;
+std::string gazeLogPath;
+bool sharedGaze = false;
+MotionGateConfig motionGateConfig;
+PartitionConfig partitionConfig;
+FrameQualityConfig frameQualityConfig;
+PowerConfig powerConfig;
+int frameBudgetMs = 0;
+DetectorPolicyConfig detectorPolicyConfig;
+SearchWindowConfig searchWindowConfig;
 
 std::unique_ptr<ITrackerModel> OnCreate(HWND hwnd);
 void OnPaint(HWND hwnd);
 void OnChar(HWND hwnd, wchar_t c);
+int RunBenchmark(int argc, LPWSTR* argv);
+std::string narrow(const std::wstring& text);
 
 typedef int(__cdecl* MYPROC)(LPWSTR);
 
@@ -43,11 +58,68 @@ int APIENTRY wWinMain(_In_ HINSTANCE hInstance,
 	_In_ int       nCmdShow)
 {
 	UNREFERENCED_PARAMETER(hPrevInstance);
-	UNREFERENCED_PARAMETER(lpCmdLine);
 
 
 	(void)HeapSetInformation(NULL, HeapEnableTerminationOnCorruption, NULL, 0);
 
+	// Headless benchmark mode: --benchmark <suite> ...
+	int argc = 0;
+	LPWSTR* argv = CommandLineToArgvW(lpCmdLine, &argc);
+	if (argv && argc > 0 && wcscmp(argv[0], L"--benchmark") == 0) {
+		int status = RunBenchmark(argc, argv);
+		LocalFree(argv);
+		return status;
+	}
+	// Periodic metrics snapshot: --metrics <file.json> [--metrics-interval ms]
+	// Gaze smoothing: --filter none|one-euro|kalman [--no-extrapolation]
+	// Gaze output: --output-rate <Hz> [--gaze-log file.csv] [--shared-gaze]
+	// Inference on every frame: --no-motion-gate [--max-reuse-age ms] [--no-partitions] [--no-quality-gate]
+	// Full camera rate without a user: --no-power-saving [--idle-after ms]
+	// Drop frames not published within a budget after capture: --frame-budget <ms>
+	// Face detector chosen at build time instead of by measured cost: --fixed-detector
+	// Full-frame face detection on every detection frame: --no-search-window
+	std::string metricsPath;
+	int metricsIntervalMs = 1000;
+	for (int i = 0; argv && i < argc; i++) {
+		if (wcscmp(argv[i], L"--metrics") == 0 && i + 1 < argc)
+			metricsPath = narrow(argv[++i]);
+		else if (wcscmp(argv[i], L"--metrics-interval") == 0 && i + 1 < argc)
+			metricsIntervalMs = std::max(10, _wtoi(argv[++i]));
+		else if (wcscmp(argv[i], L"--filter") == 0 && i + 1 < argc) {
+			std::string filter = narrow(argv[++i]);
+			gazeFilterConfig.type = filter == "kalman" ? FILTER_TYPE::KALMAN : filter == "one-euro" ? FILTER_TYPE::ONE_EURO : FILTER_TYPE::NO_FILTER;
+		}
+		else if (wcscmp(argv[i], L"--no-extrapolation") == 0)
+			gazeFilterConfig.extrapolate = false;
+		else if (wcscmp(argv[i], L"--output-rate") == 0 && i + 1 < argc)
+			outputRateHz = _wtof(argv[++i]);
+		else if (wcscmp(argv[i], L"--gaze-log") == 0 && i + 1 < argc)
+			gazeLogPath = narrow(argv[++i]);
+		else if (wcscmp(argv[i], L"--shared-gaze") == 0)
+			sharedGaze = true;
+		else if (wcscmp(argv[i], L"--no-motion-gate") == 0)
+			motionGateConfig.enabled = false;
+		else if (wcscmp(argv[i], L"--max-reuse-age") == 0 && i + 1 < argc)
+			motionGateConfig.max_reuse_age = std::chrono::milliseconds(std::max(0, _wtoi(argv[++i])));
+		else if (wcscmp(argv[i], L"--no-partitions") == 0)
+			partitionConfig.enabled = false;
+		else if (wcscmp(argv[i], L"--no-quality-gate") == 0)
+			frameQualityConfig.enabled = false;
+		else if (wcscmp(argv[i], L"--no-power-saving") == 0)
+			powerConfig.enabled = false;
+		else if (wcscmp(argv[i], L"--idle-after") == 0 && i + 1 < argc)
+			powerConfig.idle_after = std::chrono::milliseconds(std::max(0, _wtoi(argv[++i])));
+		else if (wcscmp(argv[i], L"--frame-budget") == 0 && i + 1 < argc)
+			frameBudgetMs = std::max(0, _wtoi(argv[++i]));
+		else if (wcscmp(argv[i], L"--fixed-detector") == 0)
+			detectorPolicyConfig.adaptive = false;
+		else if (wcscmp(argv[i], L"--no-search-window") == 0)
+			searchWindowConfig.enabled = false;
+	}
+	LocalFree(argv);
+	if (!metricsPath.empty())
+		metricsExporter = std::make_unique<MetricsExporter>(metricsPath, std::chrono::milliseconds(metricsIntervalMs));
+
 	// Initialize COM
 	if (FAILED(CoInitializeEx(NULL, COINIT_APARTMENTTHREADED | COINIT_DISABLE_OLE1DDE)))
 	{
@@ -179,6 +251,7 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
 	case WM_DESTROY:
 		// Hide the main window while the graph is destroyed
 		ShowWindow(hWnd, SW_HIDE);
+		model.reset(); // stops the processing thread and closes the camera
 		PostQuitMessage(0);
 		break;
 
@@ -229,6 +302,19 @@ std::unique_ptr<ITrackerModel> OnCreate(HWND hWnd) {
 	std::unique_ptr<ITrackerModel> model;
 	try {
 		model = std::make_unique<ITrackerModel>(modelFilepath);
+		model->setGazeFilter(gazeFilterConfig);
+		model->setMotionGate(motionGateConfig);
+		model->setPartitioning(partitionConfig);
+		model->setFrameQuality(frameQualityConfig);
+		model->setPowerSaving(powerConfig);
+		model->setFrameBudget(std::chrono::milliseconds(frameBudgetMs));
+		model->setDetectorPolicy(detectorPolicyConfig);
+		model->setSearchWindow(searchWindowConfig);
+		if (!gazeLogPath.empty())
+			model->addGazeSink(std::make_shared<FileGazeSink>(gazeLogPath));
+		if (sharedGaze)
+			model->addGazeSink(std::make_shared<SharedMemoryGazeSink>());
+		model->setOutputRate(outputRateHz);
 	}
 	catch (const Ort::Exception& exception) {
 		MessageBoxA(nullptr, exception.what(), "Error:", MB_OK);
@@ -254,13 +340,116 @@ void OnPaint(HWND hWnd)
 		// Minimize the window by default
 		ShowWindow(hWnd, SW_SHOWMINIMIZED);
 		// Working iTracker model inference to generate (x,y) coordinates
-		model->initCamera();
-		model->runInference();
+		if (model->initCamera())
+			model->runInference();
 	}
 
 	EndPaint(hWnd, &ps);
 }
 
+std::string narrow(const std::wstring& text) {
+	int size = WideCharToMultiByte(CP_UTF8, 0, text.c_str(), (int)text.size(), NULL, 0, NULL, NULL);
+	std::string result(size, '\0');
+	WideCharToMultiByte(CP_UTF8, 0, text.c_str(), (int)text.size(), &result[0], size, NULL, NULL);
+	return result;
+}
+
+/*
+* Writer-to-reader latency of the shared gaze channel. The reader attaches by
+* name like an external consumer and spins on the write counter.
+*/
+void BenchmarkSharedGaze(BenchmarkReport& report, int iterations, int warmup)
+{
+	const std::string name = std::string(SHARED_GAZE_CHANNEL_NAME) + ".benchmark";
+	const int total = warmup + iterations;
+	SharedGazeWriter writer;
+	SharedGazeReader reader;
+	if (!writer.create(name) || !reader.open(name)) {
+		LOG_ERROR("Cannot map %s\n", name.c_str());
+		return;
+	}
+
+	std::thread reader_thread([&]() {
+		uint64_t cursor = 0;
+		while (cursor < (uint64_t)total) {
+			reader.read_new(cursor, [&](const SharedGazeRecord& record) {
+				int64_t latency_ns = shared_gaze_now_ns() - record.publish_ns;
+				if (record.frame_id >= (uint64_t)warmup)
+					report.add("shm_publish_to_read", latency_ns);
+			});
+		}
+	});
+
+	for (int i = 0; i < total; i++) {
+		// one sample per millisecond, like a fast output rate
+		auto next = std::chrono::steady_clock::now() + std::chrono::milliseconds(1);
+		SharedGazeRecord record = {};
+		record.frame_id = i;
+		record.x = (float)i;
+		record.publish_ns = shared_gaze_now_ns();
+		writer.write(record);
+		while (std::chrono::steady_clock::now() < next) {}
+	}
+	reader_thread.join();
+	report.set_throughput(iterations, (int64_t)iterations * 1000000);
+}
+
+/*
+* --benchmark pipeline <video file|image directory> [--warmup N] [--iterations N] [--out file.json] [--trace trace.json]
+* --benchmark micro [--warmup N] [--iterations N] [--out file.json]
+* --benchmark shm [--warmup N] [--iterations N] [--out file.json]
+*/
+int RunBenchmark(int argc, LPWSTR* argv)
+{
+	std::string suite = argc > 1 ? narrow(argv[1]) : "";
+	std::string source;
+	std::string out = "benchmark_" + suite + ".json";
+	std::string trace;
+	int warmup = 30;
+	int iterations = 300;
+	for (int i = 2; i < argc; i++) {
+		if (wcscmp(argv[i], L"--warmup") == 0 && i + 1 < argc)
+			warmup = _wtoi(argv[++i]);
+		else if (wcscmp(argv[i], L"--iterations") == 0 && i + 1 < argc)
+			iterations = _wtoi(argv[++i]);
+		else if (wcscmp(argv[i], L"--out") == 0 && i + 1 < argc)
+			out = narrow(argv[++i]);
+		else if (wcscmp(argv[i], L"--trace") == 0 && i + 1 < argc)
+			trace = narrow(argv[++i]);
+		else
+			source = narrow(argv[i]);
+	}
+
+	if (suite == "pipeline") {
+		std::unique_ptr<ITrackerModel> benchmarkModel = std::make_unique<ITrackerModel>(modelFilepath);
+		benchmarkModel->setBenchmarkMode();
+		if (!benchmarkModel->initCamera(false))
+			return 1;
+		bool is_valid = benchmarkModel->benchmark_pipeline(source, warmup, iterations, out);
+		if (!trace.empty() && !TRACE_FLUSH(trace))
+			LOG_WARN("Trace not written, build with USE_TRACING\n");
+		return is_valid ? 0 : 1;
+	}
+
+	if (suite == "micro") {
+		BenchmarkReport report("micro");
+		report.set_property("hardware_threads", std::to_string(std::thread::hardware_concurrency()));
+		Microbenchmarks(report, iterations, warmup).run_all();
+		report.log();
+		return report.write_json(out) ? 0 : 1;
+	}
+
+	if (suite == "shm") {
+		BenchmarkReport report("shm");
+		BenchmarkSharedGaze(report, iterations, warmup);
+		report.log();
+		return report.write_json(out) ? 0 : 1;
+	}
+
+	LOG_ERROR("Unknown benchmark suite %s\n", suite.c_str());
+	return 1;
+}
+
 void OnChar(HWND hWnd, wchar_t c)
 {
 	switch (c)
@@ -275,6 +464,12 @@ void OnChar(HWND hWnd, wchar_t c)
 	case L'c':
 	case L'C':
 		break;
+	case L't':
+	case L'T':
+		// Timeline of the most recent spans, open in chrome://tracing or Perfetto
+		if (TRACE_FLUSH("trace.json"))
+			LOG_DEBUG("Trace written to trace.json\n");
+		break;
 	}
 }
 
@@ -0,0 +1,241 @@
+#pragma once
+#include "framework.h"
+#include "GazeSample.h"
+#include "SharedGazeChannel.h"
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <timeapi.h>
+#pragma comment(lib, "winmm.lib")
+
+#ifdef USE_EYECONTROL
+#include "EyeGazeIoctlLibrary.h"
+#pragma comment(lib, "EyeGazeIoctlLibrary.lib")
+#endif
+
+
+// Receives published gaze samples, called from a single thread at a time
+class GazeSink {
+public:
+    virtual ~GazeSink() {}
+    virtual void publish(const GazeSample& sample) = 0;
+};
+
+
+#ifdef USE_EYECONTROL
+// GazeHID virtual device, expects micrometer screen coordinates
+class HidGazeSink : public GazeSink {
+public:
+    void publish(const GazeSample& sample) override final {
+        SendGazeReportUm(sample.point.x, sample.point.y, 0);
+    }
+};
+#endif
+
+
+// One CSV line per sample: frame, publish time, point and capture-to-publish latency
+class FileGazeSink : public GazeSink {
+private:
+    std::ofstream out;
+
+public:
+    FileGazeSink(const std::string& path) : out(path, std::ios::trunc) {
+        if (!out.is_open())
+            LOG_ERROR("Cannot write %s\n", path.c_str());
+        out << "frame_id,published_us,x,y,latency_us\n";
+    }
+
+    void publish(const GazeSample& sample) override final {
+        auto published_us = std::chrono::duration_cast<std::chrono::microseconds>(sample.published.time_since_epoch()).count();
+        out << sample.frame_id << "," << published_us << "," << sample.point.x << "," << sample.point.y << "," << sample.total_us() << "\n";
+    }
+};
+
+
+// Keeps the most recent samples in memory, for tests and tools
+class MemoryGazeSink : public GazeSink {
+private:
+    std::mutex mutex;
+    std::deque<GazeSample> samples;
+    size_t capacity;
+
+public:
+    MemoryGazeSink(size_t capacity = 4096) : capacity{ capacity } {}
+
+    void publish(const GazeSample& sample) override final {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (samples.size() == capacity)
+            samples.pop_front();
+        samples.push_back(sample);
+    }
+
+    std::vector<GazeSample> snapshot() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return std::vector<GazeSample>(samples.begin(), samples.end());
+    }
+};
+
+
+// Publishes into the shared-memory ring for readers in other processes
+class SharedMemoryGazeSink : public GazeSink {
+private:
+    SharedGazeWriter writer;
+
+public:
+    SharedMemoryGazeSink(const std::string& name = SHARED_GAZE_CHANNEL_NAME, uint32_t capacity = 256) {
+        if (!writer.create(name, capacity))
+            LOG_ERROR("Cannot create shared gaze channel %s\n", name.c_str());
+    }
+
+    void publish(const GazeSample& sample) override final {
+        if (!writer.is_open())
+            return;
+        SharedGazeRecord record = {};
+        record.frame_id = sample.frame_id;
+        record.capture_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(sample.captured.time_since_epoch()).count();
+        record.publish_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(sample.published.time_since_epoch()).count();
+        record.raw_x = (float)sample.raw_point.x;
+        record.raw_y = (float)sample.raw_point.y;
+        record.x = (float)sample.point.x;
+        record.y = (float)sample.point.y;
+        record.confidence = sample.confidence;
+        record.face_x = sample.face.x;
+        record.face_y = sample.face.y;
+        record.face_width = sample.face.width;
+        record.face_height = sample.face.height;
+        writer.write(record);
+    }
+};
+
+
+/*
+* Hands gaze samples to the sinks. With a rate of 0 every pushed sample is
+* published right away on the caller's thread. With a rate, a timer thread
+* publishes at that fixed rate: inference bursts coalesce into the newest
+* sample and between inference results the point is extrapolated with the
+* filter velocity. Nothing is published once the newest sample is stale.
+*/
+class GazePublisher {
+private:
+    std::mutex sink_mutex; // serializes the sinks
+    std::vector<std::shared_ptr<GazeSink>> sinks;
+
+    std::mutex mutex;
+    GazeSample latest;
+    bool has_sample = false;
+    uint64_t pending = 0; // samples pushed since the last tick
+
+    double rate_hz = 0;
+    double max_prediction_s = 0.1;
+    cv::Size screen;    // extrapolated points are clamped to it, unless empty
+    std::chrono::milliseconds stale_after{ 200 };
+    std::condition_variable stop_requested;
+    bool stopping = false;
+    std::thread publisher_thread;
+
+    Counter& published = MetricsRegistry::instance().counter("output.published");
+    Counter& coalesced = MetricsRegistry::instance().counter("output.coalesced");
+
+    void dispatch(const GazeSample& sample) {
+        std::lock_guard<std::mutex> lock(sink_mutex);
+        for (auto& sink : sinks) {
+            sink->publish(sample);
+        }
+        published.add();
+    }
+
+    void run() {
+        timeBeginPeriod(1); // millisecond sleep resolution
+        auto period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / rate_hz));
+        auto next_tick = std::chrono::steady_clock::now();
+
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!stop_requested.wait_until(lock, next_tick, [this]() { return stopping; })) {
+            auto now = std::chrono::steady_clock::now();
+            next_tick += period;
+            if (next_tick < now)
+                next_tick = now + period; // fell behind, skip the missed ticks
+
+            if (pending > 1)
+                coalesced.add(pending - 1);
+            pending = 0;
+            if (!has_sample || now - latest.published > stale_after)
+                continue;
+
+            GazeSample sample = latest;
+            double horizon = std::min(std::chrono::duration<double>(now - latest.published).count(), max_prediction_s);
+            sample.point += cv::Point((int)(sample.velocity.x * horizon), (int)(sample.velocity.y * horizon));
+            if (!screen.empty()) {
+                sample.point.x = std::min(std::max(sample.point.x, 0), screen.width);
+                sample.point.y = std::min(std::max(sample.point.y, 0), screen.height);
+            }
+            sample.published = now;
+            lock.unlock();
+            dispatch(sample);
+            lock.lock();
+        }
+        timeEndPeriod(1);
+    }
+
+public:
+    GazePublisher() {}
+
+    ~GazePublisher() {
+        stop();
+    }
+
+    GazePublisher(const GazePublisher&) = delete;
+    GazePublisher& operator=(const GazePublisher&) = delete;
+
+    void add_sink(std::shared_ptr<GazeSink> sink) {
+        std::lock_guard<std::mutex> lock(sink_mutex);
+        sinks.push_back(sink);
+    }
+
+    void clear_sinks() {
+        std::lock_guard<std::mutex> lock(sink_mutex);
+        sinks.clear();
+    }
+
+    // 0 publishes every inference result synchronously. screenSize bounds the
+    // extrapolated points like the gaze filter bounds its output.
+    void start(double hz, double maxPredictionSeconds = 0.1, cv::Size screenSize = cv::Size()) {
+        stop();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            rate_hz = hz;
+            max_prediction_s = maxPredictionSeconds;
+            screen = screenSize;
+            stopping = false;
+            has_sample = false;
+        }
+        if (hz > 0)
+            publisher_thread = std::thread(&GazePublisher::run, this);
+    }
+
+    // Back to synchronous publishing
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        stop_requested.notify_all();
+        if (publisher_thread.joinable())
+            publisher_thread.join();
+        std::lock_guard<std::mutex> lock(mutex);
+        rate_hz = 0;
+    }
+
+    void push(const GazeSample& sample) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (rate_hz > 0) {
+                latest = sample;
+                has_sample = true;
+                pending++;
+                return;
+            }
+        }
+        dispatch(sample);
+    }
+};
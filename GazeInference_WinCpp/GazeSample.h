@@ -0,0 +1,138 @@
+#pragma once
+#include "framework.h"
+#include "Metrics.h"
+
+
+/*
+* One gaze estimate and the times its frame passed each pipeline stage.
+* captured is the camera timestamp mapped to steady_clock when the driver
+* reports one, otherwise the time the frame was grabbed.
+*/
+struct GazeSample {
+    typedef std::chrono::steady_clock::time_point time_point;
+
+    uint64_t frame_id = 0;
+    cv::Point point;        // calibrated screen coordinates
+    cv::Point raw_point;    // screen coordinates before calibration and filtering
+    cv::Rect face;          // camera pixels
+    float confidence = 1.0f;
+    cv::Point2f velocity;   // screen units per second, from the gaze filter
+    time_point captured;    // camera exposure (or grab)
+    time_point dequeued;    // taken by the processing thread
+    time_point preprocessed; // ROI tensors ready
+    time_point inferred;    // gaze regression done
+    time_point published;   // calibrated and handed to the outputs
+    time_point deadline = time_point::max(); // latest useful publish time
+
+    static int64_t elapsed_us(time_point begin, time_point end) {
+        if (begin.time_since_epoch().count() == 0 || end.time_since_epoch().count() == 0)
+            return -1;
+        return std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count();
+    }
+
+    bool has_capture_time() const {
+        return captured.time_since_epoch().count() != 0;
+    }
+
+    int64_t queue_us() const { return elapsed_us(captured, dequeued); }
+    int64_t preprocess_us() const { return elapsed_us(dequeued, preprocessed); }
+    int64_t inference_us() const { return elapsed_us(preprocessed, inferred); }
+    int64_t output_us() const { return elapsed_us(inferred, published); }
+    int64_t total_us() const { return elapsed_us(captured, published); }
+};
+
+
+enum PIPELINE_STAGE { CAPTURE_STAGE, PREPROCESS_STAGE, INFERENCE_STAGE, OUTPUT_STAGE };
+
+/*
+* Freshness budget of the frames: a frame must be published within the
+* budget after its capture. Each stage drops frames already past their
+* deadline rather than spend work on a stale gaze point. Budget 0 (default)
+* keeps every frame.
+*/
+class FrameDeadline {
+private:
+    std::chrono::microseconds budget{ 0 };
+    Counter* dropped[4] = {
+        &MetricsRegistry::instance().counter("deadline.dropped_capture"),
+        &MetricsRegistry::instance().counter("deadline.dropped_preprocess"),
+        &MetricsRegistry::instance().counter("deadline.dropped_inference"),
+        &MetricsRegistry::instance().counter("deadline.dropped_output")
+    };
+
+public:
+    void set_budget(std::chrono::microseconds frameBudget) {
+        budget = frameBudget;
+    }
+
+    bool enabled() const {
+        return budget.count() > 0;
+    }
+
+    GazeSample::time_point deadline_of(GazeSample::time_point captured) const {
+        return enabled() ? captured + budget : GazeSample::time_point::max();
+    }
+
+    // True, and counted for stage, when the sample can no longer make its deadline
+    bool missed(const GazeSample& sample, int stage, GazeSample::time_point now = std::chrono::steady_clock::now()) {
+        if (now <= sample.deadline)
+            return false;
+        drop(stage);
+        return true;
+    }
+
+    void drop(int stage) {
+        dropped[stage]->add();
+    }
+};
+
+
+/*
+* Capture-to-gaze latency objective, e.g. 99% of the samples within 100 ms.
+* Compliance is evaluated over consecutive windows of samples, a window
+* below the objective is logged once.
+*/
+class LatencySLO {
+private:
+    std::chrono::microseconds target;
+    double objective;
+    uint64_t window;
+
+    Counter& met = MetricsRegistry::instance().counter("gaze.slo_met");
+    Counter& missed = MetricsRegistry::instance().counter("gaze.slo_missed");
+    Gauge& target_us = MetricsRegistry::instance().gauge("gaze.slo_target_us");
+    std::atomic<uint64_t> window_samples{ 0 };
+    std::atomic<uint64_t> window_missed{ 0 };
+
+public:
+    LatencySLO(std::chrono::microseconds target = std::chrono::milliseconds(100), double objective = 0.99, uint64_t window = 300)
+        : target{ target }, objective{ objective }, window{ std::max<uint64_t>(1, window) }
+    {
+        target_us.set(target.count());
+    }
+
+    void set_target(std::chrono::microseconds target, double objective) {
+        this->target = target;
+        this->objective = objective;
+        target_us.set(target.count());
+    }
+
+    // True when the sample is within the target
+    bool record(int64_t latency_us) {
+        bool within = latency_us <= target.count();
+        (within ? met : missed).add();
+        if (!within)
+            window_missed.fetch_add(1, std::memory_order_relaxed);
+
+        if (window_samples.fetch_add(1, std::memory_order_relaxed) + 1 == window) {
+            uint64_t misses = window_missed.exchange(0, std::memory_order_relaxed);
+            window_samples.store(0, std::memory_order_relaxed);
+            double compliance = 1.0 - (double)misses / window;
+            if (compliance < objective) {
+                LOG_WARN("Latency SLO missed: %.1f%% of the last %llu samples within %lld us (objective %.1f%%)\n",
+                    100.0 * compliance, window, (long long)target.count(), 100.0 * objective);
+            }
+        }
+        return within;
+    }
+};
@@ -7,12 +7,28 @@
 #include <ctime>
 #include "LinearRBFCalibrator.h"
 #include "DelaunayCalibrator.h"
-
-
-#ifdef USE_EYECONTROL
-#include "EyeGazeIoctlLibrary.h"
-#pragma comment(lib, "EyeGazeIoctlLibrary.lib")
-#endif
+#include "StartupOrchestrator.h"
+#include "InferenceServer.h"
+#include "FrameParallelRunner.h"
+#include "Benchmark.h"
+#include "Metrics.h"
+#include "GazeSample.h"
+#include "GazeFilter.h"
+#include "GazeOutput.h"
+#include "MotionGate.h"
+#include "PartitionedITracker.h"
+#include "FrameQuality.h"
+#include "PowerController.h"
+#include <deque>
+#include <mutex>
+
+
+// Gaze of one tracked subject (multi-subject mode)
+struct SubjectGaze {
+    int id;
+    cv::Rect face;
+    cv::Point point; // screen coordinates
+};
 
 
 // ITracker Model
@@ -25,12 +41,86 @@ private:
     std::unique_ptr<DlibFaceDetector> detector;
     std::unique_ptr<Calibrator> calibrator;
     int calibration_type = CALIBRATION_TYPE::DELAUNAY;
+    GazeFilterConfig filter_config;
+    std::unique_ptr<GazeFilter> gaze_filter = createGazeFilter(filter_config);
+    GazePublisher gaze_publisher;
 
     std::chrono::steady_clock::time_point epoch;
     double timestamp_ms = -1;
     int frame_count = 0;
     std::thread frame_process_thread;
     std::thread inference_thread;
+    std::atomic<bool> stopping{ false };
+    std::chrono::milliseconds frame_wait_timeout{ 100 }; // bounds the shutdown latency
+
+    // Models and landmark predictor packed in one memory-mapped file
+    const char* ITRACKER_SECTION = "itracker";
+    std::wstring itrackerModelPath;
+    std::wstring assetBundlePath = L"assets/gaze_assets.bundle";
+    std::future<bool> asset_bundle_builder;
+    std::shared_ptr<AssetBundle> asset_bundle;
+
+    // Multi-subject mode: every face in the frame goes through ITracker in one
+    // batch. The largest face drives GazeHID and calibration.
+    bool multi_subject = false;
+    std::vector<FaceROI> subject_rois;
+    std::vector<std::vector<cv::Mat>> batchFrames;
+    std::vector<Output> batchOutputs;
+    std::vector<SubjectGaze> subject_gazes;
+
+    // Split face/eye graphs with cached face features, used by the
+    // single-subject loop when present next to the model
+    PartitionConfig partition_config;
+    DetectorPolicyConfig detector_policy_config;
+    SearchWindowConfig search_window_config;
+    std::unique_ptr<PartitionedITracker> partitioned;
+
+    // Shared inference service, replaces the own session when set
+    std::unique_ptr<InferenceClient> inference_client;
+
+    // Frame-parallel mode: consecutive frames run on K session replicas,
+    // gaze points are still processed in capture order
+    int frame_parallel_replicas = 1;
+    std::unique_ptr<FrameParallelRunner> frame_runner;
+    std::thread frame_result_thread;
+
+    /* Metrics */
+    Counter& frames_processed = MetricsRegistry::instance().counter("itracker.frames");
+    Counter& gaze_published = MetricsRegistry::instance().counter("itracker.gaze_points");
+    LatencyHistogram& preprocess_latency = MetricsRegistry::instance().histogram("itracker.preprocess_us");
+    LatencyHistogram& inference_latency = MetricsRegistry::instance().histogram("itracker.inference_us");
+    LatencyHistogram& output_latency = MetricsRegistry::instance().histogram("itracker.output_us");
+    LatencyHistogram& capture_wait_latency = MetricsRegistry::instance().histogram("gaze.capture_wait_us");
+    LatencyHistogram& capture_to_gaze_latency = MetricsRegistry::instance().histogram("gaze.capture_to_gaze_us");
+
+    // Stage times of the frame on the processing thread, travels with it
+    // through inference and calibration into the published sample
+    GazeSample sample;
+    LatencySLO latency_slo;
+    FrameDeadline frame_deadline;
+    std::mutex sample_mutex;
+    GazeSample last_sample;
+    // Backs off camera and detector while nobody is in front of it
+    PowerController power;
+    // Blink and blur rejection of the current frame
+    FrameQuality frame_quality;
+    FrameQualityScore quality;
+    // Skips ITracker while the ROIs are static, reusing the last prediction
+    MotionGate motion_gate;
+    bool has_prediction = false;
+    cv::Point last_prediction;          // guarded by sample_mutex
+    uint64_t last_prediction_frame = 0;
+    Counter& gate_reused = MetricsRegistry::instance().counter("gate.reused");
+    Counter& gate_inferred = MetricsRegistry::instance().counter("gate.inferred");
+
+    // Frames in flight in capture order, inferred ones and the quality holds
+    // queued behind them, so the holds are published in order
+    struct PendingFrame {
+        GazeSample sample;
+        bool hold;
+    };
+    std::mutex pending_mutex;
+    std::deque<PendingFrame> pending_frames;
 
     FLOAT xMonitorRatio;
     FLOAT yMonitorRatio;
@@ -47,34 +137,76 @@ private:
 
 
 public:
+    // Session creation is deferred to initCamera() so it overlaps
+    // with the detector, predictor and camera startup
     ITrackerModel(const wchar_t* modelFilePath) 
-        : Model{ modelFilePath }
+        : Model{ modelFilePath, true }, itrackerModelPath{ modelFilePath }
     {
-
+#ifdef USE_EYECONTROL
+        gaze_publisher.add_sink(std::make_shared<HidGazeSink>());
+#endif
     }
 
     ~ITrackerModel() {
         // Cleanup 
+        stop();
     }
 
     bool isActive() {
-        return (live_capture && live_capture->is_open() && detector);
+        return (live_capture && live_capture->is_open() && detector && (isLoaded() || inference_client));
+    }
+
+    // Send this stream's ROI tensors to a shared InferenceServer instead of
+    // running an own session, call before initCamera()
+    void useInferenceServer(std::shared_ptr<InferenceServer> server, int stream_id) {
+        inference_client = std::make_unique<InferenceClient>(server, stream_id);
     }
 
-    bool initCamera() {
+    // Brings up every component concurrently, time-to-first-gaze is 
+    // bounded by the slowest one instead of the sum.
+    // withCamera=false skips the camera, e.g. to replay recorded frames.
+    bool initCamera(bool withCamera = true) {
+        StartupOrchestrator startup;
 
-        // Initialize face ROI/landmark detector
-        detector = std::make_unique<DlibFaceDetector>();
+        // Face ROI/landmark detector and live capture are filled in by the startup tasks
+        detector = std::make_unique<DlibFaceDetector>(true);
+        detector->configure_policy(detector_policy_config);
+        detector->configure_search_window(search_window_config);
+        live_capture = std::make_unique<LiveCapture>();
+
+        // Use the mapped asset bundle, or pack the loose assets into one for the next start
+        std::shared_ptr<AssetBundle> bundle = std::make_shared<AssetBundle>();
+        if (bundle->open(assetBundlePath)) {
+            useAssetBundle(bundle, ITRACKER_SECTION);
+            detector->use_bundle(bundle);
+            asset_bundle = bundle;
+        }
+        else if (!asset_bundle_builder.valid()) {
+            asset_bundle_builder = std::async(std::launch::async, &ITrackerModel::buildAssetBundle, this);
+        }
+
+        if (!inference_client)
+            startup.launch("itracker-session", [this]() { load(); return true; });
+        if (!inference_client && partition_config.enabled && PartitionedITracker::available(itrackerModelPath)) {
+            // the monolithic session stays for batches, replicas and benchmarks
+            startup.launch("itracker-partitions", [this]() {
+                auto model = std::make_unique<PartitionedITracker>(itrackerModelPath, partition_config);
+                if (model->load())
+                    partitioned = std::move(model);
+                else
+                    LOG_WARN("ITracker partitions not usable, running the monolithic model\n");
+                return true;
+            });
+        }
+        startup.launch("face-detector", [this]() { detector->init_detector(); return true; });
+        startup.launch("landmark-predictor", [this]() { detector->init_predictor(); return true; });
+        if (withCamera)
+            startup.launch("camera", [this]() { live_capture->open(); return live_capture->is_open(); });
+        startup.launch("calibrator", [this]() { initCalibrator(); return true; });
 
 #ifdef USE_EYECONTROL
         InitializeEyeGaze();
 #endif
-        
-        // Initialize live capture and open live stream
-        live_capture = std::make_unique<LiveCapture>();
-        live_capture->open();
-
-        initCalibrator();
 
         RECT desktopRect;
         HWND desktopHwnd = GetDesktopWindow();
@@ -83,7 +215,20 @@ public:
         xMonitorRatio = (FLOAT)screenWidth / (FLOAT)desktopRect.right;
         yMonitorRatio = (FLOAT)screenHeight / (FLOAT)desktopRect.bottom;
 
-        return isActive();
+        bool ready = startup.wait_all();
+        startup.report();
+        if (!withCamera)
+            return ready && detector && isLoaded();
+        return ready && isActive();
+    }
+
+    bool buildAssetBundle() {
+        AssetBundleWriter writer;
+        writer.add_file(ITRACKER_SECTION, ASSET_KIND::ONNX_MODEL, itrackerModelPath);
+        detector->add_assets(writer);
+        bool status = writer.write(assetBundlePath);
+        LOG_DEBUG("Asset bundle %s\n", status ? "created" : "could not be created");
+        return status;
     }
 
     void initCalibrator() {
@@ -106,7 +251,19 @@ public:
         if (frame_count == 0)
             epoch = std::chrono::steady_clock::now();
 
-        bool status = live_capture->getFrame(frame);
+        std::chrono::steady_clock::time_point captured;
+        bool status = live_capture->getFrame(frame, captured, frame_wait_timeout);
+        if (status) {
+            frames_processed.add();
+            sample = GazeSample();
+            sample.frame_id = frame_count;
+            sample.captured = captured;
+            sample.dequeued = std::chrono::steady_clock::now();
+            sample.deadline = frame_deadline.deadline_of(sample.captured.time_since_epoch().count() ? sample.captured : sample.dequeued);
+            capture_wait_latency.record(std::max<int64_t>(0, sample.queue_us()));
+            if (frame_deadline.missed(sample, PIPELINE_STAGE::CAPTURE_STAGE, sample.dequeued))
+                status = false;
+        }
 
         // calculate timing properties
         frame_count++;
@@ -122,13 +279,17 @@ public:
     }
 
     bool applyTransformations() {
+        ScopedLatency latency(preprocess_latency);
         // Apply ROI Extraction through dlib
         // frame in BGR and roi_frames YCbCr
-        std::vector<cv::Mat> roi_frames = detector->ROIExtraction(frame, live_capture->downscaling);
+        std::vector<cv::Mat> roi_frames = detector->ROIExtraction(frame, live_capture->downscaling_for(frame.size()));
 
         if (roi_frames.size() != 4) {
             return false;
         }
+        if (motion_gate.enabled())
+            motion_gate.observe(roi_frames, detector->last_landmarks());
+        quality = frame_quality.enabled() ? frame_quality.assess(roi_frames, detector->last_landmarks()) : FrameQualityScore();
 
         // TODO: Make it faster by initing the preprocessedFrames and reusing
         preprocessedFrames.clear();
@@ -137,12 +298,86 @@ public:
             cv::dnn::blobFromImage(roi_frames[i], roi_frames[i]);
             preprocessedFrames.push_back(roi_frames[i]);
         }
+        sample.face = detector->last_face();
+        sample.preprocessed = std::chrono::steady_clock::now();
         return true;
     }
 
+    void setMultiSubject(bool enable) {
+        multi_subject = enable;
+    }
+
+    std::vector<SubjectGaze> getSubjectGazes() {
+        return subject_gazes;
+    }
+
+    bool applyTransformationsAll() {
+        ScopedLatency latency(preprocess_latency);
+        subject_rois = detector->ROIExtractionAll(frame, live_capture->downscaling_for(frame.size()));
+        if (subject_rois.empty()) {
+            return false;
+        }
+
+        batchFrames.resize(subject_rois.size());
+        for (size_t n = 0; n < subject_rois.size(); n++) {
+            std::vector<cv::Mat>& roi_frames = subject_rois[n].roi_images;
+            batchFrames[n].resize(roi_frames.size());
+            for (size_t i = 0; i < roi_frames.size(); i++) {
+                // HWC to CHW
+                cv::dnn::blobFromImage(roi_frames[i], batchFrames[n][i]);
+            }
+        }
+        sample.preprocessed = std::chrono::steady_clock::now();
+        return true;
+    }
+
+    /*
+    * Largest face is the primary subject, the only one calibrated, filtered
+    * and published. The calibration belongs to the primary user, so the
+    * other subjects get their uncalibrated screen points.
+    */
+    std::vector<SubjectGaze> processOutputs() {
+        size_t primary = 0;
+        for (size_t n = 1; n < subject_rois.size(); n++) {
+            if (subject_rois[n].face.area() > subject_rois[primary].face.area())
+                primary = n;
+        }
+
+        subject_gazes.clear();
+        if (batchOutputs.empty() || batchOutputs[0].values.size() < 2 * subject_rois.size())
+            return subject_gazes;
+
+        const size_t stride = batchOutputs[0].values.size() / subject_rois.size();
+        for (size_t n = 0; n < subject_rois.size(); n++) {
+            const float* values = batchOutputs[0].values.data() + n * stride;
+            cv::Point predictedPoint = cv::Point(values[0], values[1]);
+            if (n == primary)
+                sample.face = subject_rois[n].face;
+            cv::Point point = (n == primary) ? processOutput(predictedPoint, sample) : cam2screen(predictedPoint, screenWidth, screenHeight);
+            subject_gazes.push_back({ subject_rois[n].id, subject_rois[n].face, point });
+            LOG_DEBUG("Subject %d (%d, %d)\n", subject_rois[n].id, point.x, point.y);
+        }
+        return subject_gazes;
+    }
+
+    cv::Point calibratePoint(cv::Point point) {
+        if (this->calibrator->isActive())
+            return this->calibrator->evaluate(point);
+        return point;
+    }
+
     cv::Point processOutput() {
-        cv::Point predictedPoint = cv::Point(outputs[0].values[0], outputs[0].values[1]);
+        return processOutput(cv::Point(outputs[0].values[0], outputs[0].values[1]));
+    }
+
+    // frameSample carries the stage times of the frame the point was predicted from
+    cv::Point processOutput(cv::Point predictedPoint, GazeSample frameSample = GazeSample()) {
+        TRACE_SCOPE("ITrackerModel::processOutput");
+        ScopedLatency latency(output_latency);
+        frameSample.inferred = std::chrono::steady_clock::now();
         LOG_DEBUG("x=%.2f, y=%.2f\n", predictedPoint.x, predictedPoint.y);
+        if (frame_deadline.missed(frameSample, PIPELINE_STAGE::OUTPUT_STAGE, frameSample.inferred))
+            return calibratePoint(cam2screen(predictedPoint, screenWidth, screenHeight)); // not published
 
         // Convert to screen coordinates
         cv::Point point = cam2screen(predictedPoint, screenWidth, screenHeight);
@@ -217,35 +452,424 @@ public:
         }
         LOG_DEBUG("Predicted (%d, %d) | Calibrated (%d, %d)\n", point.x, point.y, calibratedPoint.x, calibratedPoint.y);
 
-#ifdef USE_EYECONTROL
-        // Send to GazeHID
-        SendGazeReportUm(calibratedPoint.x, calibratedPoint.y, 0);
-#endif
+        frameSample.raw_point = point;
+        cv::Point filteredPoint = filterGaze(calibratedPoint, frameSample);
+        publishGaze(filteredPoint, frameSample);
+        return filteredPoint;
+    }
+
+    // Call before runInference()
+    void setGazeFilter(const GazeFilterConfig& config) {
+        filter_config = config;
+        gaze_filter = createGazeFilter(filter_config);
+    }
+
+    /*
+    * Smooths the calibrated point and, with extrapolation on, predicts it from
+    * the capture time to now so the published point does not lag by the
+    * pipeline latency. Works in normalized screen units.
+    */
+    cv::Point filterGaze(cv::Point calibratedPoint, GazeSample& frameSample) {
+        auto seconds = [](std::chrono::steady_clock::time_point time) {
+            return std::chrono::duration<double>(time.time_since_epoch()).count();
+        };
+        double now_s = seconds(std::chrono::steady_clock::now());
+        double sample_s = frameSample.has_capture_time() ? seconds(frameSample.captured) : now_s;
+
+        gaze_filter->update(cv::Point2f(calibratedPoint.x / (float)screenWidth, calibratedPoint.y / (float)screenHeight), sample_s);
+        cv::Point2f filtered = filter_config.extrapolate
+            ? gaze_filter->predict(now_s, filter_config.max_prediction_s)
+            : gaze_filter->position();
+
+        cv::Point2f velocity = gaze_filter->velocity();
+        frameSample.velocity = cv::Point2f(velocity.x * screenWidth, velocity.y * screenHeight);
+
+        filtered.x = std::min(std::max(filtered.x, 0.0f), 1.0f);
+        filtered.y = std::min(std::max(filtered.y, 0.0f), 1.0f);
+        return cv::Point((int)(filtered.x * screenWidth), (int)(filtered.y * screenHeight));
+    }
+
+    void publishGaze(cv::Point calibratedPoint, GazeSample frameSample = GazeSample()) {
+        gaze_published.add();
+        frameSample.point = calibratedPoint;
+        frameSample.published = std::chrono::steady_clock::now();
+        if (frameSample.has_capture_time()) {
+            int64_t total_us = frameSample.total_us();
+            capture_to_gaze_latency.record(std::max<int64_t>(0, total_us));
+            latency_slo.record(total_us);
+        }
+        {
+            std::lock_guard<std::mutex> lock(sample_mutex);
+            last_sample = frameSample;
+        }
+        gaze_publisher.push(frameSample);
+    }
+
+    // Receives the published gaze (GazeHID is added with USE_EYECONTROL)
+    void addGazeSink(std::shared_ptr<GazeSink> sink) {
+        gaze_publisher.add_sink(sink);
+    }
 
-        return calibratedPoint;
+    // Publish at a fixed rate independent of the inference rate, 0 publishes
+    // every inference result as it comes
+    void setOutputRate(double hz) {
+        gaze_publisher.start(hz, filter_config.max_prediction_s, cv::Size(screenWidth, screenHeight));
+    }
+
+    GazeSample getLastGazeSample() {
+        std::lock_guard<std::mutex> lock(sample_mutex);
+        return last_sample;
+    }
+
+    // Capture-to-gaze objective, e.g. 99% of the samples within 100 ms
+    void setLatencySLO(std::chrono::milliseconds target, double objective = 0.99) {
+        latency_slo.set_target(target, objective);
+    }
+
+    // Number of session replicas for frame-parallel inference, call before runInference()
+    void setFrameParallel(int replicas) {
+        frame_parallel_replicas = std::max(1, replicas);
+    }
+
+    std::unique_ptr<FrameParallelRunner> createFrameRunner(int replicas, int intraOpThreads) {
+        return std::make_unique<FrameParallelRunner>(itrackerModelPath.c_str(), replicas, intraOpThreads,
+            asset_bundle, ITRACKER_SECTION);
+    }
+
+    int coresPerReplica(int replicas) {
+        return std::max(1, (int)std::thread::hardware_concurrency() / replicas);
+    }
+
+    void processFrameParallel() {
+        frame_runner = createFrameRunner(frame_parallel_replicas, coresPerReplica(frame_parallel_replicas));
+
+        // Calibration and GazeHID see the gaze points in capture order
+        frame_result_thread = std::thread([this]() {
+            FrameResult result;
+            while (frame_runner->next(result)) {
+                GazeSample frameSample;
+                {
+                    std::lock_guard<std::mutex> lock(pending_mutex);
+                    frameSample = pending_frames.front().sample;
+                }
+                if (result.is_valid)
+                    processOutput(cv::Point(result.outputs[0].values[0], result.outputs[0].values[1]), frameSample);
+                else
+                    frame_deadline.missed(frameSample, PIPELINE_STAGE::INFERENCE_STAGE); // counts deadline drops, not failures
+                completePendingFrame();
+            }
+        });
+
+        while (!stopping) {
+            if (!getFrame())
+                continue;
+            if (!updatePowerMode(applyTransformations()))
+                continue;
+            if (holdLowQualityFrame())
+                continue;
+            if (frame_deadline.missed(sample, PIPELINE_STAGE::PREPROCESS_STAGE))
+                continue;
+            // Queued before submit(), so it is there when the result arrives
+            queuePendingFrame(sample);
+            frame_runner->submit(std::move(preprocessedFrames), sample.deadline);
+        }
     }
 
     void processFrame() {
+        TRACE_THREAD_NAME("processing");
+        if (frame_parallel_replicas > 1 && !inference_client && !multi_subject) {
+            processFrameParallel();
+            return;
+        }
+
         bool is_valid;
         int i = 0;
-        while (true) { 
+        while (!stopping) { 
             i++;
             is_valid = getFrame(); //reads a new frame
             if (!is_valid)
                 continue;
-            is_valid = applyTransformations();
+            if (multi_subject) {
+                // The quality and motion gates work on the primary face's
+                // landmarks and ROIs, this mode does not use them
+                is_valid = updatePowerMode(applyTransformationsAll());
+                if (!is_valid)
+                    continue;
+                if (frame_deadline.missed(sample, PIPELINE_STAGE::PREPROCESS_STAGE))
+                    continue;
+                {
+                    ScopedLatency latency(inference_latency);
+                    is_valid = runBatch(batchFrames, batchOutputs, sample.deadline);
+                }
+                if (frame_deadline.missed(sample, PIPELINE_STAGE::INFERENCE_STAGE) || !is_valid)
+                    continue;
+                processOutputs();
+                continue;
+            }
+            is_valid = updatePowerMode(applyTransformations());
             if (!is_valid)
                 continue;
-            fillInputTensor();
-            run();
-            processOutput();
+            if (holdLowQualityFrame())
+                continue;
+            if (frame_deadline.missed(sample, PIPELINE_STAGE::PREPROCESS_STAGE))
+                continue;
+            if (reuseStaticPrediction())
+                continue;
+            if (inference_client) {
+                runOnServer();
+                continue;
+            }
+            if (partitioned) {
+                runPartitioned();
+                continue;
+            }
+
+            // Inference of this frame overlaps with capture and ROI extraction
+            // of the next one, results are processed on the Model worker
+            ModelSlot* slot = acquireSlot();
+            slot->preprocessedFrames = std::move(preprocessedFrames);
+            slot->deadline = sample.deadline;
+            auto submitted = std::chrono::steady_clock::now();
+            GazeSample frameSample = sample;
+            queuePendingFrame(frameSample);
+            runAsync(slot, [this, submitted, frameSample](ModelSlot* done) {
+                inference_latency.record_since(submitted);
+                bool inferred = !done->cancelled;
+                cv::Point prediction;
+                if (inferred) {
+                    prediction = cv::Point(done->outputs[0].values[0], done->outputs[0].values[1]);
+                    processOutput(prediction, frameSample);
+                }
+                else {
+                    frame_deadline.missed(frameSample, PIPELINE_STAGE::INFERENCE_STAGE); // counts deadline drops, not failures
+                }
+                completePendingFrame();
+                // last, the motion gate may reuse the prediction on the processing thread from here on
+                if (inferred)
+                    recordPrediction(prediction, frameSample.frame_id);
+            });
+        }
+    }
+
+    /*
+    * Switches the camera and detector between full and low power by whether
+    * the frame had a face, and paces the loop while in low power. Returns
+    * face_found.
+    */
+    bool updatePowerMode(bool face_found) {
+        if (!power.enabled() || !live_capture)
+            return face_found;
+
+        if (power.update(face_found, sample.dequeued)) {
+            const PowerConfig& config = power.configuration();
+            if (power.current_mode() == POWER_MODE::LOW_POWER) {
+                live_capture->reconfigure(config.idle_frame_rate, config.idle_resolution);
+                detector->set_detect_interval(config.idle_detect_interval);
+            }
+            else {
+                live_capture->restore_configuration();
+                detector->set_detect_interval(detector->default_detect_interval());
+            }
+        }
+        if (!face_found && power.current_mode() == POWER_MODE::LOW_POWER) {
+            power.throttle();
+            live_capture->discard_queued();
+        }
+        return face_found;
+    }
+
+    // Call before runInference()
+    void setPowerSaving(const PowerConfig& config) {
+        power.configure(config);
+    }
+
+    /*
+    * Frames rejected by the quality gate skip inference. The last published
+    * point is held with this frame's times and confidence 0, so consumers
+    * see the gap instead of an outlier, and calibration never sees it. With
+    * frames in flight the hold waits until they are published.
+    */
+    bool holdLowQualityFrame() {
+        if (quality.accepted())
+            return false;
+
+        std::lock_guard<std::mutex> lock(pending_mutex);
+        if (pending_frames.empty())
+            publishHold(sample);
+        else
+            pending_frames.push_back({ sample, true });
+        return true;
+    }
+
+    void publishHold(const GazeSample& frameSample) {
+        GazeSample hold;
+        {
+            std::lock_guard<std::mutex> lock(sample_mutex);
+            hold = last_sample;
+        }
+        if (hold.published.time_since_epoch().count() == 0)
+            return; // nothing published yet
+        hold.frame_id = frameSample.frame_id;
+        hold.face = frameSample.face;
+        hold.confidence = 0;
+        hold.velocity = cv::Point2f();
+        hold.captured = frameSample.captured;
+        hold.dequeued = frameSample.dequeued;
+        hold.preprocessed = frameSample.preprocessed;
+        hold.inferred = frameSample.preprocessed;
+        hold.published = std::chrono::steady_clock::now();
+        gaze_publisher.push(hold);
+    }
+
+    void queuePendingFrame(const GazeSample& frameSample) {
+        std::lock_guard<std::mutex> lock(pending_mutex);
+        pending_frames.push_back({ frameSample, false });
+    }
+
+    // After the oldest inferred frame was published or dropped, publishes the holds queued behind it
+    void completePendingFrame() {
+        std::lock_guard<std::mutex> lock(pending_mutex);
+        pending_frames.pop_front();
+        while (!pending_frames.empty() && pending_frames.front().hold) {
+            publishHold(pending_frames.front().sample);
+            pending_frames.pop_front();
+        }
+    }
+
+    // Call before runInference()
+    void setFrameQuality(const FrameQualityConfig& config) {
+        frame_quality.configure(config);
+    }
+
+    void recordPrediction(cv::Point prediction, uint64_t frame_id) {
+        std::lock_guard<std::mutex> lock(sample_mutex);
+        last_prediction = prediction;
+        last_prediction_frame = frame_id;
+        has_prediction = true;
+    }
+
+    /*
+    * Publishes the last prediction again, with this frame's timestamps, when
+    * the ROIs did not change since the frame it was inferred from. Only once
+    * that result is published and nothing else is in flight, so the output
+    * order is kept and the filter and calibrator are only used by this thread.
+    * Otherwise this frame becomes the new reference and is inferred.
+    */
+    bool reuseStaticPrediction() {
+        if (!motion_gate.enabled())
+            return false;
+
+        bool ready;
+        cv::Point prediction;
+        {
+            std::lock_guard<std::mutex> lock(sample_mutex);
+            ready = has_prediction && last_prediction_frame == motion_gate.reference_frame_id();
+            prediction = last_prediction;
+        }
+        if (ready) {
+            std::lock_guard<std::mutex> lock(pending_mutex);
+            ready = pending_frames.empty();
+        }
+        if (!ready || !motion_gate.is_static(sample.preprocessed)) {
+            motion_gate.mark_inferred(sample.frame_id, sample.preprocessed);
+            gate_inferred.add();
+            return false;
+        }
+
+        gate_reused.add();
+        sample.inferred = sample.preprocessed;
+        processOutput(prediction, sample);
+        return true;
+    }
+
+    // Frames not published within budget after capture are dropped, 0 keeps all. Call before runInference()
+    void setFrameBudget(std::chrono::milliseconds budget) {
+        frame_deadline.set_budget(budget);
+    }
+
+    // Call before runInference()
+    void setMotionGate(const MotionGateConfig& config) {
+        motion_gate.configure(config);
+    }
+
+    // Call before initCamera()
+    void setDetectorPolicy(const DetectorPolicyConfig& config) {
+        detector_policy_config = config;
+    }
+
+    // Call before initCamera()
+    void setSearchWindow(const SearchWindowConfig& config) {
+        search_window_config = config;
+    }
+
+    // Call before initCamera()
+    void setPartitioning(const PartitionConfig& config) {
+        partition_config = config;
+    }
+
+    // Synchronous on the processing thread, like runOnServer()
+    void runPartitioned() {
+        auto submitted = std::chrono::steady_clock::now();
+        cv::Point2f gaze;
+        bool is_valid = partitioned->infer(preprocessedFrames, sample.face, submitted, sample.deadline, gaze);
+        inference_latency.record_since(submitted);
+        if (frame_deadline.missed(sample, PIPELINE_STAGE::INFERENCE_STAGE) || !is_valid)
+            return;
+        cv::Point prediction(gaze);
+        recordPrediction(prediction, sample.frame_id);
+        processOutput(prediction, sample);
+    }
+
+    bool runOnServer() {
+        try {
+            auto submitted = std::chrono::steady_clock::now();
+            std::future<std::vector<Output>> pending = inference_client->infer(preprocessedFrames);
+            // a server batch cannot be terminated for one stream, stop waiting for it instead
+            if (pending.wait_until(sample.deadline) == std::future_status::timeout) {
+                frame_deadline.missed(sample, PIPELINE_STAGE::INFERENCE_STAGE);
+                return false;
+            }
+            std::vector<Output> results = pending.get();
+            inference_latency.record_since(submitted);
+            if (frame_deadline.missed(sample, PIPELINE_STAGE::INFERENCE_STAGE))
+                return false;
+            cv::Point prediction(results[0].values[0], results[0].values[1]);
+            recordPrediction(prediction, sample.frame_id);
+            processOutput(prediction, sample);
+            return true;
+        }
+        catch (const std::exception& e) {
+            LOG_ERROR("Stream %d: %s\n", inference_client->id(), e.what());
+            return false;
         }
     }
 
     void runInference() {
+        stopping = false;
         frame_process_thread = std::thread(&ITrackerModel::processFrame, this);
     }
 
+    /*
+    * Ends the processing loop within one frame wait, lets the inference in
+    * flight publish its result and closes the camera. Called on destruction.
+    */
+    void stop() {
+        stopping = true;
+        if (frame_process_thread.joinable())
+            frame_process_thread.join();
+        if (frame_runner) {
+            frame_runner->close();
+            if (frame_result_thread.joinable())
+                frame_result_thread.join();
+            frame_runner.reset();
+        }
+        if (isLoaded())
+            waitForAsyncRuns();
+        gaze_publisher.stop();
+        if (live_capture)
+            live_capture->close();
+    }
+
     int benchmark() {
         cv::Mat frame;
         std::vector<cv::Mat> roi_images;
@@ -336,6 +960,163 @@ public:
         return avgLatency_ms;
     }
 
+    /*
+    * Makes benchmark_pipeline() reproducible: the build-time detector on the
+    * whole frame, no timed probes or search window, and gaze output to memory
+    * instead of GazeHID or other devices. Call before initCamera(false).
+    */
+    void setBenchmarkMode() {
+        detector_policy_config.adaptive = false;
+        search_window_config.enabled = false;
+        gaze_publisher.clear_sinks();
+        gaze_publisher.add_sink(std::make_shared<MemoryGazeSink>(1));
+    }
+
+    /*
+    * Per-stage latency of the whole pipeline on a fixed video file or image
+    * directory. warmup frames are processed but not recorded. Stages are
+    * timed with steady_clock in ns and written as JSON to jsonPath.
+    * Call setBenchmarkMode() and initCamera(false) first.
+    */
+    bool benchmark_pipeline(const std::string& source, int warmup, int iterations, const std::string& jsonPath) {
+        BenchmarkFrameSource frames;
+        if (!frames.open(source)) {
+            LOG_ERROR("Cannot open benchmark source %s\n", source.c_str());
+            return false;
+        }
+
+        BenchmarkReport report("pipeline");
+        report.set_property("source", source);
+        report.set_property("onnxruntime", OrtGetApiBase()->GetVersionString());
+        report.set_property("hardware_threads", std::to_string(std::thread::hardware_concurrency()));
+        report.set_property("warmup", std::to_string(warmup));
+        report.set_property("face_detector", DetectorPolicy::name(detector->active_detector()));
+        report.set_property("detector_policy", detector_policy_config.adaptive ? "adaptive" : "fixed");
+        report.set_property("search_window", search_window_config.enabled ? "on" : "off");
+
+        // total and throughput only count frames that went through every stage
+        size_t faces_found = 0;
+        int64_t completed_ns = 0;
+        for (int i = 0; i < warmup + iterations; i++) {
+            BenchmarkReport* sink = (i < warmup) ? nullptr : &report;
+            auto begin = std::chrono::steady_clock::now();
+
+            {
+                ScopedStageTimer timer(sink, "decode");
+                if (!frames.read(frame))
+                    continue;
+            }
+            cv::Size downscaling = live_capture->downscaling_for(frame.size());
+
+            // Same path as ROIExtraction: one YCbCr conversion, landmarks on its luma.
+            // Frames between detections reuse the last face, they are a stage of their own.
+            std::vector<cv::Point2f> face_shape_vector;
+            cv::Mat inputImageYCbCr;
+            {
+                ScopedStageTimer timer(sink, detector->detection_due() ? "detection_landmarks" : "tracked_landmarks");
+                detector->wait_until_ready();
+                if (!detector->find_primary_face(frame, face_shape_vector, downscaling, inputImageYCbCr))
+                    continue;
+            }
+
+            std::vector<cv::Mat> roi_frames;
+            {
+                ScopedStageTimer timer(sink, "roi_crops");
+                std::vector<cv::RotatedRect> rectangles;
+                if (!detector->landmarksToRects(face_shape_vector, rectangles))
+                    continue;
+                detector->crop_face_eye_images(inputImageYCbCr, rectangles, roi_frames);
+                detector->resize_ROI_images(roi_frames);
+                for (auto& image : roi_frames) {
+                    image.convertTo(image, CV_32FC3, 1.0 / 255.0);
+                }
+            }
+
+            {
+                ScopedStageTimer timer(sink, "tensor_fill");
+                preprocessedFrames.resize(roi_frames.size());
+                for (size_t r = 0; r < roi_frames.size(); r++) {
+                    cv::dnn::blobFromImage(roi_frames[r], preprocessedFrames[r]);
+                }
+                fillInputTensor();
+            }
+
+            {
+                ScopedStageTimer timer(sink, "inference");
+                run();
+            }
+
+            cv::Point calibratedPoint;
+            {
+                ScopedStageTimer timer(sink, "calibration");
+                cv::Point predictedPoint = cv::Point(outputs[0].values[0], outputs[0].values[1]);
+                calibratedPoint = calibratePoint(cam2screen(predictedPoint, screenWidth, screenHeight));
+            }
+
+            {
+                ScopedStageTimer timer(sink, "output");
+                publishGaze(calibratedPoint);
+            }
+            if (sink) {
+                int64_t total_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count();
+                report.add("total", total_ns);
+                completed_ns += total_ns;
+                faces_found++;
+            }
+        }
+
+        report.set_throughput(faces_found, completed_ns);
+        report.set_property("frames_with_face", std::to_string(faces_found));
+        report.log();
+        return report.write_json(jsonPath);
+    }
+
+    // Throughput of K session replicas (cores / K intra-op threads each)
+    // against a single session scaled through intra-op threads only
+    void benchmark_replicas(int maxReplicas) {
+        const int numTests = 100;
+        const int cores = std::max(1, (int)std::thread::hardware_concurrency());
+
+        // One valid preprocessed frame is replayed
+        bool is_valid = false;
+        for (int i = 0; i < numTests && !is_valid; i++) {
+            is_valid = getFrame() && applyTransformations();
+        }
+        if (!is_valid) {
+            LOG_ERROR("No face found for the replica benchmark.\n");
+            return;
+        }
+        std::vector<cv::Mat> sample = preprocessedFrames;
+
+        auto measure = [&](int replicas, int intraOpThreads) {
+            std::unique_ptr<FrameParallelRunner> runner = createFrameRunner(replicas, intraOpThreads);
+            std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+            std::thread producer([&]() {
+                for (int i = 0; i < numTests; i++) {
+                    std::vector<cv::Mat> frames;
+                    for (auto& frame : sample)
+                        frames.push_back(frame.clone());
+                    runner->submit(std::move(frames));
+                }
+            });
+            FrameResult result;
+            for (int i = 0; i < numTests; i++) {
+                runner->next(result);
+            }
+            std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+            producer.join();
+            double seconds = std::chrono::duration<double>(end - begin).count();
+            LOG_DEBUG("[replicas] K=%d intra=%d | %.1f fps\n", replicas, intraOpThreads, numTests / seconds);
+        };
+
+        for (int intraOpThreads = 1; intraOpThreads <= cores; intraOpThreads *= 2) {
+            measure(1, intraOpThreads);
+        }
+        for (int replicas = 2; replicas <= maxReplicas; replicas *= 2) {
+            measure(replicas, coresPerReplica(replicas));
+        }
+    }
+
     int benchmark_dlib() {
         std::vector<cv::Mat> roi_images;
         bool is_valid;
@@ -360,7 +1141,7 @@ public:
             if (detector)
                 detector.release();
             detector = std::make_unique<DlibFaceDetector>();
-
+            detector->wait_until_ready();
         }
         end = std::chrono::steady_clock::now();
         int avgDetectorInitLatency_ms = std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count() / static_cast<float>(5);
@@ -370,7 +1151,7 @@ public:
         begin = std::chrono::steady_clock::now();
         for (int i = 0; i < numTests; i++)
         {
-            is_valid = detector->find_primary_face_ultraFace(frame, face_shape_vector, live_capture->downscaling);
+            is_valid = detector->find_primary_face(frame, face_shape_vector, live_capture->downscaling_for(frame.size()));
         }
         end = std::chrono::steady_clock::now();
         int avgFaceDetectionLatency_ms = std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count() / static_cast<float>(numTests);
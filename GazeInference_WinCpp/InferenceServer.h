@@ -0,0 +1,194 @@
+#pragma once
+#include "framework.h"
+#include "Model.h"
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+
+struct InferenceRequest {
+    int stream_id;
+    std::vector<cv::Mat> frames; // one preprocessed (CHW) tensor per model input
+    std::chrono::steady_clock::time_point enqueued;
+    std::promise<std::vector<Output>> result;
+};
+
+struct InferenceServerStats {
+    uint64_t batches = 0;
+    uint64_t samples = 0;
+    double queue_delay_ms = 0;  // summed over samples
+    double run_ms = 0;          // summed over batches
+
+    double mean_batch_size() const {
+        return batches ? (double)samples / batches : 0;
+    }
+};
+
+
+/*
+* Local inference service shared by many camera streams. Clients enqueue
+* preprocessed ROI tensors, a scheduler thread forms dynamic batches of up to
+* maxBatchSize requests, waiting at most maxQueueDelay for the oldest one,
+* runs them with a single Model::runBatch and scatters the results back.
+*/
+class InferenceServer {
+private:
+    std::unique_ptr<Model> model;
+    size_t maxBatchSize;
+    std::chrono::microseconds maxQueueDelay;
+
+    std::mutex mutex;
+    std::condition_variable queue_changed;
+    std::deque<InferenceRequest> queue;
+    bool stopping = false;
+    InferenceServerStats statistics;
+    std::thread scheduler_thread;
+
+    void schedule() {
+        std::vector<InferenceRequest> batch;
+        std::vector<std::vector<cv::Mat>> batchFrames;
+        std::vector<Output> batchOutputs;
+
+        while (true) {
+            batch.clear();
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                queue_changed.wait(lock, [this]() { return stopping || !queue.empty(); });
+                if (queue.empty())
+                    return; // stopping
+
+                // Fill the batch until it is full or the oldest request is due
+                auto deadline = queue.front().enqueued + maxQueueDelay;
+                queue_changed.wait_until(lock, deadline, [this]() { return stopping || queue.size() >= maxBatchSize; });
+
+                while (!queue.empty() && batch.size() < maxBatchSize) {
+                    batch.push_back(std::move(queue.front()));
+                    queue.pop_front();
+                }
+            }
+            execute(batch, batchFrames, batchOutputs);
+        }
+    }
+
+    void execute(std::vector<InferenceRequest>& batch, std::vector<std::vector<cv::Mat>>& batchFrames, std::vector<Output>& batchOutputs) {
+        auto begin = std::chrono::steady_clock::now();
+        batchFrames.resize(batch.size());
+        for (size_t n = 0; n < batch.size(); n++) {
+            batchFrames[n] = std::move(batch[n].frames);
+        }
+
+        model->runBatch(batchFrames, batchOutputs);
+        auto end = std::chrono::steady_clock::now();
+
+        // Scatter, sample n owns the nth slice of every output
+        for (size_t n = 0; n < batch.size(); n++) {
+            std::vector<Output> sampleOutputs(batchOutputs.size());
+            bool is_valid = !batchOutputs.empty();
+            for (size_t o = 0; o < batchOutputs.size(); o++) {
+                const std::vector<float>& values = batchOutputs[o].values;
+                size_t stride = values.size() / batch.size();
+                is_valid &= (stride > 0);
+                sampleOutputs[o].name = batchOutputs[o].name;
+                sampleOutputs[o].dims = batchOutputs[o].dims;
+                sampleOutputs[o].dims[0] = 1;
+                sampleOutputs[o].values.assign(values.begin() + n * stride, values.begin() + (n + 1) * stride);
+            }
+
+            if (is_valid)
+                batch[n].result.set_value(std::move(sampleOutputs));
+            else
+                batch[n].result.set_exception(std::make_exception_ptr(std::runtime_error("Batched inference failed")));
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        statistics.batches++;
+        statistics.samples += batch.size();
+        statistics.run_ms += std::chrono::duration<double, std::milli>(end - begin).count();
+        for (auto& request : batch) {
+            statistics.queue_delay_ms += std::chrono::duration<double, std::milli>(begin - request.enqueued).count();
+        }
+    }
+
+public:
+    InferenceServer(const wchar_t* modelFilePath, size_t maxBatchSize = 8, std::chrono::microseconds maxQueueDelay = std::chrono::microseconds(4000))
+        : model{ std::make_unique<Model>(modelFilePath) }, maxBatchSize{ std::max<size_t>(1, maxBatchSize) }, maxQueueDelay{ maxQueueDelay }
+    {
+        scheduler_thread = std::thread(&InferenceServer::schedule, this);
+    }
+
+    ~InferenceServer() {
+        // Pending requests are still served before the scheduler exits
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        queue_changed.notify_all();
+        if (scheduler_thread.joinable())
+            scheduler_thread.join();
+    }
+
+    InferenceServer(const InferenceServer&) = delete;
+    InferenceServer& operator=(const InferenceServer&) = delete;
+
+    std::future<std::vector<Output>> submit(int stream_id, std::vector<cv::Mat> frames) {
+        InferenceRequest request;
+        request.stream_id = stream_id;
+        request.frames = std::move(frames);
+        request.enqueued = std::chrono::steady_clock::now();
+        std::future<std::vector<Output>> result = request.result.get_future();
+
+        bool wake;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            queue.push_back(std::move(request));
+            // The scheduler only needs waking for the first request or a full batch
+            wake = queue.size() == 1 || queue.size() >= maxBatchSize;
+        }
+        if (wake)
+            queue_changed.notify_one();
+        return result;
+    }
+
+    size_t queue_size() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return queue.size();
+    }
+
+    InferenceServerStats stats() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return statistics;
+    }
+
+    void report() {
+        InferenceServerStats s = stats();
+        LOG_DEBUG("[server] batches %llu | samples %llu | mean batch %.2f | mean queue delay %.2f ms | mean run %.2f ms\n",
+            s.batches, s.samples, s.mean_batch_size(),
+            s.samples ? s.queue_delay_ms / s.samples : 0.0,
+            s.batches ? s.run_ms / s.batches : 0.0);
+    }
+};
+
+
+/*
+* In-process stand-in for a stream's connection to the InferenceServer.
+*/
+class InferenceClient {
+private:
+    std::shared_ptr<InferenceServer> server;
+    int stream_id;
+
+public:
+    InferenceClient(std::shared_ptr<InferenceServer> server, int stream_id)
+        : server{ server }, stream_id{ stream_id }
+    {
+
+    }
+
+    std::future<std::vector<Output>> infer(std::vector<cv::Mat> frames) {
+        return server->submit(stream_id, std::move(frames));
+    }
+
+    int id() const {
+        return stream_id;
+    }
+};
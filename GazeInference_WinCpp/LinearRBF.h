@@ -437,6 +437,14 @@ namespace GazeInference_WinCpp
 			return true;
 		}
 
+		//
+		//Rebuilds the RBF from all calibration points (the Add/Remove methods do this already)
+		//
+		void PrepareAll()
+		{
+			Prepare((int)_calibrationPoints.size());
+		}
+
 	private:
 		//
 		// Creates a new linear RBF from (Input, output) pairs.
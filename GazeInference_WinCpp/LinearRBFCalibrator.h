@@ -2,6 +2,7 @@
 #include "framework.h";
 #include "LinearRBF.h"
 #include "Calibrator.h"
+#include "Tracing.h"
 
 class LinearRBFCalibrator : public Calibrator {
 
@@ -27,6 +28,7 @@ public:
 	}
 
 	void add(cv::Point2f actualPt, cv::Point2f predictedPt, bool remap = true) override final {
+		TRACE_SCOPE("LinearRBFCalibrator::add");
 		// Add to the lists
 		this->actual_coordinates.push_back(actualPt);
 		this->predicted_coordinates.push_back(predictedPt);
@@ -39,6 +41,7 @@ public:
 	}
 
 	cv::Point2f evaluate (cv::Point2f predictedPt) override final {
+		TRACE_SCOPE("LinearRBFCalibrator::evaluate");
 		//Evaluate
 		double xTranlated, yTranlated;
 		_linearRBF.Evaluate(predictedPt.x, predictedPt.y, xTranlated, yTranlated);
@@ -1,11 +1,20 @@
 #pragma once
 #include "framework.h"
 #include "cv_constants.h"
+#include "Tracing.h"
+#include "Metrics.h"
+#include <condition_variable>
+#include <mutex>
 #include <queue>
 
 
 enum STATE { DORMANT, RUNNING, INACTIVE};
 
+struct CapturedFrame {
+    cv::Mat image;
+    std::chrono::steady_clock::time_point timestamp;
+};
+
 class LiveCapture
 {
 private:
@@ -14,10 +23,30 @@ private:
     int FRAME_RATE = 30;
     cv::Size RESOLUTION = cv::Size(1280, 720);
     const int buffer_length = 30;
-    std::queue<cv::Mat> frame_queue = std::queue<cv::Mat>();
+    std::queue<CapturedFrame> frame_queue = std::queue<CapturedFrame>();
+    std::mutex queue_mutex;
+    std::condition_variable frame_queued; // also signalled when the grabber stops
     std::thread frame_grabber_thread;
-    int state = STATE::INACTIVE;
+    std::atomic<int> state{ STATE::INACTIVE };
     //int state = STATE::DORMANT;
+
+    /* Metrics */
+    Counter& frames_captured = MetricsRegistry::instance().counter("capture.frames");
+    Counter& frames_dropped = MetricsRegistry::instance().counter("capture.dropped");
+    Counter& read_failures = MetricsRegistry::instance().counter("capture.read_failures");
+    Gauge& queue_depth = MetricsRegistry::instance().gauge("capture.queue_depth");
+    LatencyHistogram& read_latency = MetricsRegistry::instance().histogram("capture.read_us");
+
+    // Driver timestamps (CAP_PROP_POS_MSEC) mapped onto steady_clock. The
+    // offset is the smallest seen, i.e. that of the fastest delivered frame.
+    bool driver_timestamps = true;
+    double driver_offset_ms = std::numeric_limits<double>::max();
+
+    // Settings requested while the grabber thread owns the camera
+    std::mutex settings_mutex;
+    std::atomic<bool> settings_pending{ false };
+    int pending_frame_rate = 0;
+    cv::Size pending_resolution;
     
 
     const std::vector<cv::Size> CommonResolutions = {
@@ -33,7 +62,6 @@ public:
     /* member variables */
     cv::VideoCapture capture;
     cv::String window_name = "Camera Feed";
-    cv::Size downscaling = cv::Size(1.0, 1.0);
     cv::Size active_resolution;
     int active_frame_rate;
 
@@ -188,17 +216,24 @@ public:
             //cv::namedWindow(window_name, cv::WINDOW_NORMAL); //create a window
 
             if (state != STATE::INACTIVE) {
-                // initialize the frame_grabber_thread
+                // initialize the frame_grabber_thread, RUNNING before it starts so close() cannot miss it
+                state = STATE::RUNNING;
                 frame_grabber_thread = std::thread(&LiveCapture::grabFrame, this);
             }
         }
     }
 
+    // Stops the grabber thread, waiting getFrame() calls return false
     void close() {
         if (state == STATE::RUNNING) {
-            state = STATE::DORMANT;
-            frame_grabber_thread.join();
+            {
+                std::lock_guard<std::mutex> lock(queue_mutex);
+                state = STATE::DORMANT;
+            }
+            frame_queued.notify_all();
         }
+        if (frame_grabber_thread.joinable())
+            frame_grabber_thread.join();
         capture.release();
     }
 
@@ -222,13 +257,48 @@ public:
         capture.set(cv::CAP_PROP_FRAME_WIDTH, width);
         capture.set(cv::CAP_PROP_FRAME_HEIGHT, height);
 
-        // Update downscaling factors for dlib detector
         active_resolution = cv::Size(capture.get(cv::CAP_PROP_FRAME_WIDTH), capture.get(cv::CAP_PROP_FRAME_HEIGHT));
-        downscaling.width = active_resolution.width / CommonResolutions[0].width;
-        downscaling.height = active_resolution.height / CommonResolutions[0].height;
         return active_resolution;
     }
 
+    /*
+    * Frame rate and resolution of an open camera. With the grabber thread
+    * running they are applied by that thread between two reads.
+    */
+    void reconfigure(int fps, cv::Size resolution) {
+        if (state == STATE::RUNNING) {
+            std::lock_guard<std::mutex> lock(settings_mutex);
+            pending_frame_rate = fps;
+            pending_resolution = resolution;
+            settings_pending = true;
+            return;
+        }
+        set_resolution(resolution);
+        set_frame_rate(fps);
+    }
+
+    // Back to the frame rate and resolution the camera was opened with
+    void restore_configuration() {
+        reconfigure(FRAME_RATE, RESOLUTION);
+    }
+
+    // Drops the queued frames, the next getFrame() returns a fresh one
+    void discard_queued() {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        while (!frame_queue.empty()) {
+            frame_queue.pop();
+            frames_dropped.add();
+        }
+        queue_depth.set(0);
+    }
+
+    // Downscaling factors of the dlib detector for a frame of this size. Taken
+    // from the frame itself, as queued frames can predate a resolution change.
+    cv::Size downscaling_for(cv::Size frameSize) const {
+        return cv::Size(std::max(1, frameSize.width / CommonResolutions[0].width),
+            std::max(1, frameSize.height / CommonResolutions[0].height));
+    }
+
     
     bool getFrameFromImagePath(std::string imageFilepath, cv::Mat& frame) {
         frame = cv::imread(imageFilepath, cv::ImreadModes::IMREAD_COLOR);
@@ -240,37 +310,95 @@ public:
     }
 
     bool getFrame(cv::Mat& frame) {
+        std::chrono::steady_clock::time_point timestamp;
+        return getFrame(frame, timestamp);
+    }
+
+    /*
+    * timestamp is the capture time of the frame on steady_clock. Blocks up to
+    * timeout for a frame, false when none arrived or the capture was closed.
+    */
+    bool getFrame(cv::Mat& frame, std::chrono::steady_clock::time_point& timestamp,
+        std::chrono::milliseconds timeout = std::chrono::milliseconds(100)) {
         if (state == STATE::INACTIVE) {
-            return capture.read(frame); // read a new frame from video 
+            // read() blocks until the next frame, a failing camera is retried after a while
+            bool status = capture.read(frame); // read a new frame from video 
+            if (!status) {
+                std::this_thread::sleep_for(timeout);
+                return false;
+            }
+            timestamp = captureTime();
+            return status;
         }
         else if (state == STATE::RUNNING) {
-            if (frame_queue.size() > 0) {
-                frame = frame_queue.front();
-                frame_queue.pop();
-                return (!frame.empty());
-            }
-            else {
+            std::unique_lock<std::mutex> lock(queue_mutex);
+            if (!frame_queued.wait_for(lock, timeout, [this]() { return !frame_queue.empty() || state != STATE::RUNNING; })
+                || frame_queue.empty()) {
                 return false;
             }
+            frame = frame_queue.front().image;
+            timestamp = frame_queue.front().timestamp;
+            frame_queue.pop();
+            queue_depth.set(frame_queue.size());
+            return (!frame.empty());
         }
         else {
+            std::this_thread::sleep_for(timeout); // closed
             return false;
         }
     }
 
+    // Call right after a read
+    std::chrono::steady_clock::time_point captureTime() {
+        auto now = std::chrono::steady_clock::now();
+        double driver_ms = driver_timestamps ? capture.get(cv::CAP_PROP_POS_MSEC) : 0;
+        if (driver_ms <= 0) {
+            driver_timestamps = false; // not reported by this backend
+            return now;
+        }
+
+        double now_ms = std::chrono::duration<double, std::milli>(now.time_since_epoch()).count();
+        driver_offset_ms = std::min(driver_offset_ms, now_ms - driver_ms);
+        auto timestamp = std::chrono::steady_clock::time_point(std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double, std::milli>(driver_offset_ms + driver_ms)));
+        return std::min(timestamp, now);
+    }
+
     void grabFrame() {
-        cv::Mat frame;
-        state = STATE::RUNNING;
+        TRACE_THREAD_NAME("capture");
         // to stop the thread state could be set DORMANT outside
         while (state == STATE::RUNNING) {
-            capture.read(frame);
-            // If queue is full remove a frame from the front
-            if (frame_queue.size() == buffer_length) {
-                frame_queue.pop();
+            TRACE_SCOPE("LiveCapture::grabFrame");
+            if (settings_pending) {
+                std::lock_guard<std::mutex> lock(settings_mutex);
+                set_resolution(pending_resolution);
+                set_frame_rate(pending_frame_rate);
+                settings_pending = false;
+            }
+            auto begin = std::chrono::steady_clock::now();
+            cv::Mat frame; // fresh buffer, read() would overwrite the queued frames in place
+            if (!capture.read(frame)) {
+                read_failures.add();
+                std::this_thread::sleep_for(std::chrono::milliseconds(1000 / std::max(1, FRAME_RATE)));
+                continue;
             }
+            auto timestamp = captureTime();
+            read_latency.record_since(begin);
+            frames_captured.add();
 
-            // push at the back of the queue
-            frame_queue.push(frame);
+            {
+                std::lock_guard<std::mutex> lock(queue_mutex);
+                // If queue is full remove a frame from the front
+                if (frame_queue.size() == buffer_length) {
+                    frame_queue.pop();
+                    frames_dropped.add();
+                }
+
+                // push at the back of the queue
+                frame_queue.push({ frame, timestamp });
+                queue_depth.set(frame_queue.size());
+            }
+            frame_queued.notify_one();
             //LOG_DEBUG("Queue: %d\n", frame_queue.size());
         }
     }
@@ -0,0 +1,108 @@
+#pragma once
+#include "framework.h"
+#include <cstdint>
+
+
+/*
+* 64-bit FNV-1a hash. Used to key on-disk artifacts (model cache, asset
+* bundle) on their content. Pass a previous result as seed to chain inputs.
+*/
+inline uint64_t fnv1a_hash(const void* data, size_t length, uint64_t seed = 14695981039346656037ULL) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    uint64_t hash = seed;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+inline uint64_t fnv1a_hash(const std::string& text, uint64_t seed = 14695981039346656037ULL) {
+    return fnv1a_hash(text.data(), text.size(), seed);
+}
+
+
+/*
+* Read-only memory mapping of a whole file.
+* Pages are backed by the file itself, so every process mapping the same
+* file shares the same physical memory.
+*/
+class MappedFile {
+private:
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = NULL;
+    const void* view = nullptr;
+    size_t length = 0;
+
+public:
+    MappedFile() {}
+
+    MappedFile(const std::wstring& path) {
+        open(path);
+    }
+
+    ~MappedFile() {
+        close();
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const std::wstring& path) {
+        close();
+
+        file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+            close();
+            return false;
+        }
+        length = static_cast<size_t>(fileSize.QuadPart);
+
+        mapping = CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mapping == NULL) {
+            close();
+            return false;
+        }
+
+        view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        if (view == nullptr) {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close() {
+        if (view) {
+            UnmapViewOfFile(view);
+            view = nullptr;
+        }
+        if (mapping) {
+            CloseHandle(mapping);
+            mapping = NULL;
+        }
+        if (file != INVALID_HANDLE_VALUE) {
+            CloseHandle(file);
+            file = INVALID_HANDLE_VALUE;
+        }
+        length = 0;
+    }
+
+    bool is_open() const {
+        return view != nullptr;
+    }
+
+    const void* data() const {
+        return view;
+    }
+
+    size_t size() const {
+        return length;
+    }
+};
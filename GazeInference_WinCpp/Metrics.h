@@ -0,0 +1,286 @@
+#pragma once
+#include "framework.h"
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <sstream>
+
+
+/*
+* Process-wide metrics. Counters, gauges and histograms are plain atomics,
+* updating them never locks. The registry mutex is only taken to create a
+* metric (components keep a reference) and to take a snapshot, so readers
+* never block the pipeline threads.
+*/
+class Counter {
+private:
+    std::atomic<uint64_t> value{ 0 };
+
+public:
+    void add(uint64_t n = 1) {
+        value.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    uint64_t get() const {
+        return value.load(std::memory_order_relaxed);
+    }
+};
+
+
+class Gauge {
+private:
+    std::atomic<int64_t> value{ 0 };
+
+public:
+    void set(int64_t v) {
+        value.store(v, std::memory_order_relaxed);
+    }
+
+    int64_t get() const {
+        return value.load(std::memory_order_relaxed);
+    }
+};
+
+
+struct HistogramSnapshot {
+    uint64_t count = 0;
+    double mean_us = 0;
+    uint64_t p50_us = 0;
+    uint64_t p90_us = 0;
+    uint64_t p99_us = 0;
+    uint64_t p999_us = 0;
+    uint64_t max_us = 0;
+};
+
+
+/*
+* Log-linear (HDR style) latency histogram in microseconds. Values below 16
+* are exact, above that every power of two is split into 16 buckets, so a
+* percentile is within 6.25% of the recorded value. Tracks up to ~19 hours.
+*/
+class LatencyHistogram {
+public:
+    static const int SUB_BUCKET_BITS = 4;
+    static const int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+    static const int MAX_EXPONENT = 35;
+    static const int BUCKET_COUNT = (MAX_EXPONENT - SUB_BUCKET_BITS + 2) * SUB_BUCKETS;
+
+private:
+    std::array<std::atomic<uint64_t>, BUCKET_COUNT> buckets{};
+    std::atomic<uint64_t> count{ 0 };
+    std::atomic<uint64_t> sum_us{ 0 };
+    std::atomic<uint64_t> max_us{ 0 };
+
+    static int highest_bit(uint64_t value) {
+        int bit = 0;
+        for (int shift = 32; shift > 0; shift /= 2) {
+            if (value >> shift) {
+                value >>= shift;
+                bit += shift;
+            }
+        }
+        return bit;
+    }
+
+    static int bucket_index(uint64_t value) {
+        if (value < SUB_BUCKETS)
+            return (int)value;
+        int exponent = std::min(highest_bit(value), MAX_EXPONENT);
+        int sub_bucket = (int)((value >> (exponent - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1));
+        return (exponent - SUB_BUCKET_BITS + 1) * SUB_BUCKETS + sub_bucket;
+    }
+
+    // Highest value that falls into the bucket
+    static uint64_t bucket_upper(int index) {
+        if (index < SUB_BUCKETS)
+            return index;
+        int exponent = index / SUB_BUCKETS + SUB_BUCKET_BITS - 1;
+        uint64_t width = 1ull << (exponent - SUB_BUCKET_BITS);
+        return ((uint64_t)(SUB_BUCKETS + index % SUB_BUCKETS) << (exponent - SUB_BUCKET_BITS)) + width - 1;
+    }
+
+public:
+    void record(uint64_t value_us) {
+        buckets[bucket_index(value_us)].fetch_add(1, std::memory_order_relaxed);
+        count.fetch_add(1, std::memory_order_relaxed);
+        sum_us.fetch_add(value_us, std::memory_order_relaxed);
+        uint64_t current = max_us.load(std::memory_order_relaxed);
+        while (value_us > current && !max_us.compare_exchange_weak(current, value_us, std::memory_order_relaxed)) {}
+    }
+
+    void record_since(std::chrono::steady_clock::time_point begin) {
+        record(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - begin).count());
+    }
+
+    // Concurrent records may be half included, good enough for monitoring
+    HistogramSnapshot snapshot() const {
+        HistogramSnapshot result;
+        std::array<uint64_t, BUCKET_COUNT> counts;
+        uint64_t total = 0;
+        for (int i = 0; i < BUCKET_COUNT; i++) {
+            counts[i] = buckets[i].load(std::memory_order_relaxed);
+            total += counts[i];
+        }
+        if (total == 0)
+            return result;
+
+        result.count = total;
+        result.mean_us = (double)sum_us.load(std::memory_order_relaxed) / count.load(std::memory_order_relaxed);
+        result.max_us = max_us.load(std::memory_order_relaxed);
+
+        const double percentiles[] = { 50, 90, 99, 99.9 };
+        uint64_t* targets[] = { &result.p50_us, &result.p90_us, &result.p99_us, &result.p999_us };
+        for (int p = 0; p < 4; p++) {
+            uint64_t rank = std::max<uint64_t>(1, (uint64_t)std::ceil(percentiles[p] / 100.0 * total));
+            uint64_t seen = 0;
+            for (int i = 0; i < BUCKET_COUNT; i++) {
+                seen += counts[i];
+                if (seen >= rank) {
+                    *targets[p] = std::min(bucket_upper(i), result.max_us);
+                    break;
+                }
+            }
+        }
+        return result;
+    }
+};
+
+
+// Records the enclosing scope into a histogram
+class ScopedLatency {
+private:
+    LatencyHistogram& histogram;
+    std::chrono::steady_clock::time_point begin;
+
+public:
+    ScopedLatency(LatencyHistogram& histogram) : histogram{ histogram }, begin{ std::chrono::steady_clock::now() } {}
+
+    ~ScopedLatency() {
+        histogram.record_since(begin);
+    }
+};
+
+
+class MetricsRegistry {
+private:
+    std::mutex mutex;
+    std::map<std::string, std::unique_ptr<Counter>> counters;
+    std::map<std::string, std::unique_ptr<Gauge>> gauges;
+    std::map<std::string, std::unique_ptr<LatencyHistogram>> histograms;
+
+    template <typename T>
+    T& get_or_create(std::map<std::string, std::unique_ptr<T>>& metrics, const std::string& name) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto& metric = metrics[name];
+        if (!metric)
+            metric = std::make_unique<T>();
+        return *metric;
+    }
+
+public:
+    static MetricsRegistry& instance() {
+        static MetricsRegistry registry;
+        return registry;
+    }
+
+    // Same name, same metric; the reference stays valid for the process lifetime
+    Counter& counter(const std::string& name) {
+        return get_or_create(counters, name);
+    }
+
+    Gauge& gauge(const std::string& name) {
+        return get_or_create(gauges, name);
+    }
+
+    LatencyHistogram& histogram(const std::string& name) {
+        return get_or_create(histograms, name);
+    }
+
+    std::string snapshot_json() {
+        std::ostringstream json;
+        json.setf(std::ios::fixed);
+        json.precision(1);
+        auto now = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+        json << "{\n  \"timestamp_ms\": " << now << ",\n  \"counters\": {";
+
+        std::lock_guard<std::mutex> lock(mutex);
+        bool first = true;
+        for (auto& counter : counters) {
+            json << (first ? "\n" : ",\n") << "    \"" << counter.first << "\": " << counter.second->get();
+            first = false;
+        }
+        json << "\n  },\n  \"gauges\": {";
+        first = true;
+        for (auto& gauge : gauges) {
+            json << (first ? "\n" : ",\n") << "    \"" << gauge.first << "\": " << gauge.second->get();
+            first = false;
+        }
+        json << "\n  },\n  \"histograms\": {";
+        first = true;
+        for (auto& histogram : histograms) {
+            HistogramSnapshot s = histogram.second->snapshot();
+            json << (first ? "\n" : ",\n") << "    \"" << histogram.first << "\": { \"count\": " << s.count
+                << ", \"mean_us\": " << s.mean_us << ", \"p50_us\": " << s.p50_us << ", \"p90_us\": " << s.p90_us
+                << ", \"p99_us\": " << s.p99_us << ", \"p999_us\": " << s.p999_us << ", \"max_us\": " << s.max_us << " }";
+            first = false;
+        }
+        json << "\n  }\n}\n";
+        return json.str();
+    }
+};
+
+
+/*
+* Writes a registry snapshot to a JSON file at a fixed interval. The file is
+* replaced atomically, a reader never sees a partial snapshot.
+*/
+class MetricsExporter {
+private:
+    std::string path;
+    std::chrono::milliseconds interval;
+    std::mutex mutex;
+    std::condition_variable stop_requested;
+    bool stopping = false;
+    std::thread exporter_thread;
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!stop_requested.wait_for(lock, interval, [this]() { return stopping; })) {
+            export_now();
+        }
+        export_now();
+    }
+
+public:
+    MetricsExporter(const std::string& path, std::chrono::milliseconds interval = std::chrono::milliseconds(1000))
+        : path{ path }, interval{ interval }
+    {
+        exporter_thread = std::thread(&MetricsExporter::run, this);
+    }
+
+    ~MetricsExporter() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        stop_requested.notify_all();
+        if (exporter_thread.joinable())
+            exporter_thread.join();
+    }
+
+    MetricsExporter(const MetricsExporter&) = delete;
+    MetricsExporter& operator=(const MetricsExporter&) = delete;
+
+    bool export_now() {
+        std::string temp_path = path + ".tmp";
+        {
+            std::ofstream out(temp_path, std::ios::trunc);
+            if (!out.is_open())
+                return false;
+            out << MetricsRegistry::instance().snapshot_json();
+            if (!out.good())
+                return false;
+        }
+        return MoveFileExA(temp_path.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+    }
+};
@@ -0,0 +1,267 @@
+#pragma once
+#include "framework.h"
+#include "Benchmark.h"
+#include "DlibFaceDetector.h"
+#include "DelaunayCalibrator.h"
+#include "LinearRBF.h"
+#include "GenMatrix.h"
+#include "cam2screen.h"
+#include <functional>
+
+
+/*
+* Isolated timings of the hot kernels over parameterized sizes. Inputs are
+* synthetic and generated from a fixed seed, so the numbers are comparable
+* between runs and builds. Stage names are "<kernel>/<parameter>".
+*/
+class Microbenchmarks {
+private:
+    BenchmarkReport& report;
+    int iterations;
+    int warmup;
+    cv::RNG rng{ 42 };
+
+    const std::vector<cv::Size> frame_sizes = { cv::Size(640, 480), cv::Size(1280, 720), cv::Size(1920, 1080) };
+    const std::vector<int> crop_sizes = { 128, 256, 512 };
+    const std::vector<int> box_counts = { 8, 64, 512 };
+    const std::vector<int> matrix_sizes = { 8, 16, 32, 64 };
+    const std::vector<int> calibration_counts = { 4, 16, 64, 256 };
+
+    // setup runs before every iteration and is not timed
+    void measure(const std::string& stage, std::function<void()> kernel, std::function<void()> setup = nullptr) {
+        for (int i = 0; i < warmup + iterations; i++) {
+            if (setup)
+                setup();
+            auto begin = std::chrono::steady_clock::now();
+            kernel();
+            auto end = std::chrono::steady_clock::now();
+            if (i >= warmup)
+                report.add(stage, std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count());
+        }
+    }
+
+    // Every kernel result goes through keep(), the volatile stores cannot be
+    // optimized out and neither can the work that produced them
+    volatile double kept_value = 0;
+    const void* volatile kept_pointer = nullptr;
+
+    void keep(double value) {
+        kept_value = value;
+    }
+
+    void keep(const void* pointer) {
+        kept_pointer = pointer;
+    }
+
+    void keep(const cv::Mat& image) {
+        keep((const void*)image.data);
+    }
+
+    void keep(cv::Point2f point) {
+        keep((double)point.x + point.y);
+    }
+
+    static std::string size_name(cv::Size size) {
+        return std::to_string(size.width) + "x" + std::to_string(size.height);
+    }
+
+    cv::Mat random_frame(cv::Size size) {
+        cv::Mat frame(size, CV_8UC3);
+        rng.fill(frame, cv::RNG::UNIFORM, 0, 256);
+        return frame;
+    }
+
+    // Eye-sized rotated rectangle somewhere inside the frame
+    cv::RotatedRect random_rect(cv::Size frameSize, float side) {
+        cv::Point2f center(rng.uniform(side, frameSize.width - side), rng.uniform(side, frameSize.height - side));
+        return cv::RotatedRect(center, cv::Size2f(side, side), rng.uniform(-20.0f, 20.0f));
+    }
+
+    GenMatrix random_matrix(int n) {
+        // diagonally dominant, so it is always invertible
+        GenMatrix matrix(n, n);
+        for (int r = 0; r < n; r++) {
+            for (int c = 0; c < n; c++) {
+                matrix(r, c) = rng.uniform(-1.0, 1.0) + (r == c ? n : 0);
+            }
+        }
+        return matrix;
+    }
+
+public:
+    Microbenchmarks(BenchmarkReport& report, int iterations, int warmup = 10)
+        : report{ report }, iterations{ iterations }, warmup{ warmup }
+    {
+
+    }
+
+    void run_all() {
+        image_kernels();
+        detector_kernels();
+        matrix_kernels();
+        calibration_kernels();
+    }
+
+    void image_kernels() {
+        DlibFaceDetector detector(true); // kernels only, no models loaded
+
+        for (auto& size : frame_sizes) {
+            cv::Mat frame = random_frame(size);
+            cv::RotatedRect face_rect = random_rect(size, size.height / 3.0f);
+
+            measure("cvtColor_BRG2YCbCr/" + size_name(size), [&]() {
+                keep(detector.cvtColor_BRG2YCbCr(frame));
+            });
+            measure("crop_rect/" + size_name(size), [&]() {
+                keep(detector.crop_rect(frame, face_rect));
+            });
+            measure("generate_grid/" + size_name(size), [&]() {
+                keep(detector.generate_grid(size, face_rect));
+            });
+        }
+
+        for (int side : crop_sizes) {
+            std::vector<cv::Mat> source(4), roi_images;
+            for (auto& image : source) {
+                image = random_frame(cv::Size(side, side));
+            }
+            measure("resize_ROI_images/" + std::to_string(side), [&]() {
+                detector.resize_ROI_images(roi_images);
+                keep(roi_images[0]);
+            }, [&]() {
+                roi_images = source;
+            });
+        }
+    }
+
+    void detector_kernels() {
+        std::unique_ptr<UltraFaceNet> ultraFaceNet;
+        try {
+            ultraFaceNet = std::make_unique<UltraFaceNet>(L"assets/version-slim-320_without_postprocessing.onnx");
+        }
+        catch (const Ort::Exception& e) {
+            LOG_WARN("UltraFace kernels skipped: %s\n", e.what());
+            return;
+        }
+
+        const int anchors = ultraFaceNet->anchor_count();
+        const float score_threshold = 0.7f;
+        ultraFaceNet->set_image_size(cv::Size(1280, 720));
+
+        for (int count : box_counts) {
+            // count anchors above the threshold, spread over the feature maps
+            std::vector<float> scores(2 * anchors, 0.1f);
+            std::vector<float> boxes(4 * anchors);
+            for (auto& value : boxes) {
+                value = rng.uniform(-1.0f, 1.0f);
+            }
+            int selected = std::min(count, anchors);
+            for (int i = 0; i < selected; i++) {
+                scores[2 * ((size_t)i * anchors / selected) + 1] = rng.uniform(0.75f, 1.0f);
+            }
+
+            std::vector<FaceInfo> bbox_collection;
+            measure("generateBBox/" + std::to_string(count), [&]() {
+                ultraFaceNet->generateBBox(bbox_collection, scores, boxes, score_threshold, anchors);
+                keep((double)bbox_collection.size());
+            }, [&]() {
+                bbox_collection.clear();
+            });
+
+            // clusters of 8 overlapping boxes, like around a real face
+            std::vector<FaceInfo> candidates;
+            float x = 0, y = 0;
+            for (int i = 0; i < count; i++) {
+                if (i % 8 == 0) {
+                    x = rng.uniform(0.0f, 1100.0f);
+                    y = rng.uniform(0.0f, 540.0f);
+                }
+                float dx = rng.uniform(-8.0f, 8.0f), dy = rng.uniform(-8.0f, 8.0f);
+                candidates.push_back({ x + dx, y + dy, x + dx + 160, y + dy + 160, rng.uniform(0.7f, 1.0f), nullptr });
+            }
+
+            std::vector<FaceInfo> input, output;
+            measure("nms/" + std::to_string(count), [&]() {
+                ultraFaceNet->nms(input, output, NMS_TYPE::BLENDING);
+                keep((double)output.size());
+            }, [&]() {
+                input = candidates;
+                output.clear();
+            });
+        }
+    }
+
+    void matrix_kernels() {
+        for (int n : matrix_sizes) {
+            GenMatrix a = random_matrix(n);
+            GenMatrix b = random_matrix(n);
+            measure("GenMatrix::operator*/" + std::to_string(n), [&]() {
+                GenMatrix product = a * b;
+                keep(product(n - 1, n - 1));
+            });
+
+            GenMatrix inverse(n, n);
+            measure("GenMatrix::Invert/" + std::to_string(n), [&]() {
+                inverse.Invert();
+                keep(inverse(0, 0));
+            }, [&]() {
+                inverse = a;
+            });
+        }
+    }
+
+    void calibration_kernels() {
+        const cv::Rect screen(0, 0, 1920, 1080);
+
+        for (int count : calibration_counts) {
+            // Calibration targets on a grid, predictions jittered around them
+            std::vector<cv::Point2f> actual, predicted;
+            int columns = (int)std::ceil(std::sqrt(count * 16.0 / 9.0));
+            int rows = (count + columns - 1) / columns;
+            for (int i = 0; i < count; i++) {
+                cv::Point2f target((i % columns + 0.5f) * screen.width / columns, (i / columns + 0.5f) * screen.height / rows);
+                actual.push_back(target);
+                predicted.push_back(target + cv::Point2f(rng.uniform(-30.0f, 30.0f), rng.uniform(-30.0f, 30.0f)));
+            }
+            std::vector<cv::Point2f> queries;
+            for (int i = 0; i < 64; i++) {
+                queries.push_back(cv::Point2f(rng.uniform(0.0f, (float)screen.width), rng.uniform(0.0f, (float)screen.height)));
+            }
+
+            GazeInference_WinCpp::LinearRBF linearRBF(20, 0.025f);
+            linearRBF.InitializeCalibrationTransform(0, 0, screen.width, screen.height, 0.025f, false, 0);
+            for (int i = 0; i < count; i++) {
+                double qx, qy, ox, oy;
+                linearRBF.AddTranslation(predicted[i].x, predicted[i].y, actual[i].x, actual[i].y, 1, &qx, &qy, &ox, &oy);
+            }
+            measure("LinearRBF::Prepare/" + std::to_string(count), [&]() {
+                linearRBF.PrepareAll();
+                keep((const void*)&linearRBF);
+            });
+
+            size_t query = 0;
+            measure("LinearRBF::Evaluate/" + std::to_string(count), [&]() {
+                double x, y;
+                linearRBF.Evaluate(queries[query].x, queries[query].y, x, y);
+                keep(x + y);
+            }, [&]() {
+                query = (query + 1) % queries.size();
+            });
+
+            DelaunayCalibrator delaunay(screen);
+            delaunay.add(actual, predicted);
+            measure("DelaunayCalibrator::evaluate/" + std::to_string(count), [&]() {
+                keep(delaunay.evaluate(queries[query]));
+            }, [&]() {
+                query = (query + 1) % queries.size();
+            });
+        }
+
+        // read through a volatile, so the inline kernel is not folded into a constant
+        volatile int predictedX = -3, predictedY = -5;
+        measure("cam2screen", [&]() {
+            cv::Point screenPoint = cam2screen(cv::Point(predictedX, predictedY), screen.width, screen.height);
+            keep((double)screenPoint.x + screenPoint.y);
+        });
+    }
+};
@@ -1,5 +1,14 @@
 #pragma once
 #include "framework.h"
+#include "MappedFile.h"
+#include "AssetBundle.h"
+#include "Tracing.h"
+#include "Metrics.h"
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
 
 
 #ifdef USE_DML
@@ -33,6 +42,90 @@ struct Output {
     std::vector<float> values;
 };
 
+// One input/output buffer set of a Model for runAsync(). The caller owns a
+// slot from acquireSlot() until its run has completed, see runAsync().
+struct ModelSlot {
+    std::vector<cv::Mat> preprocessedFrames;
+    std::vector<Input> inputs;
+    std::vector<Output> outputs;
+    std::vector<Ort::Value> inputTensors;
+    std::vector<Ort::Value> outputTensors;
+    // Set by the caller, runs not finished by then are skipped or terminated
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+    bool cancelled = false; // outputs are not valid
+};
+
+
+/*
+* Sets the terminate flag of session runs that overrun their deadline. One
+* thread serves every run of a model, runs without a deadline never use it.
+*/
+class RunWatchdog {
+private:
+    struct Watch {
+        std::chrono::steady_clock::time_point deadline;
+        Ort::RunOptions* options;
+    };
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::map<uint64_t, Watch> watches;
+    uint64_t next_id = 0;
+    bool stopping = false;
+    std::thread thread;
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!stopping) {
+            if (watches.empty()) {
+                changed.wait(lock);
+                continue;
+            }
+            auto first = std::min_element(watches.begin(), watches.end(),
+                [](const std::pair<const uint64_t, Watch>& a, const std::pair<const uint64_t, Watch>& b) { return a.second.deadline < b.second.deadline; });
+            auto deadline = first->second.deadline;
+            if (std::chrono::steady_clock::now() >= deadline) {
+                first->second.options->SetTerminate();
+                watches.erase(first);
+                continue;
+            }
+            changed.wait_until(lock, deadline);
+        }
+    }
+
+public:
+    RunWatchdog() {}
+
+    ~RunWatchdog() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        changed.notify_all();
+        if (thread.joinable())
+            thread.join();
+    }
+
+    uint64_t watch(Ort::RunOptions& options, std::chrono::steady_clock::time_point deadline) {
+        uint64_t id;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!thread.joinable())
+                thread = std::thread(&RunWatchdog::run, this);
+            id = next_id++;
+            watches[id] = { deadline, &options };
+        }
+        changed.notify_all();
+        return id;
+    }
+
+    // True when the run was terminated
+    bool unwatch(uint64_t id) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return watches.erase(id) == 0;
+    }
+};
+
 template <typename T>
 T vectorProduct(const std::vector<T>& v)
 {
@@ -49,14 +142,54 @@ class Model {
 private:   
     // Basic ONNX Runtime Setup
     Ort::Env env = Ort::Env(ORT_LOGGING_LEVEL_WARNING);
+    MappedFile cachedModel; // must outlive the session created from it
+    std::shared_ptr<AssetBundle> bundle; // optional source of the model bytes
+    std::string bundleSection;
     Ort::Session session{ nullptr };
 
     std::vector<const char*> inputNames;
     std::vector<const char*> outputNames;
     std::vector<Ort::Value> inputTensors;
     std::vector<Ort::Value> outputTensors;
-    const int numInterOpsThreads = 16;
-    const int numIntraOpsThreads = 16;
+    std::vector<std::vector<float>> batchInputValues; // reused by runBatch
+    bool dynamicBatch = true; // all inputs have a dynamic leading dimension
+    int numInterOpsThreads = 16;
+    int numIntraOpsThreads = 16;
+    GraphOptimizationLevel graphOptimizationLevel = GraphOptimizationLevel::ORT_ENABLE_ALL;
+
+    // Asynchronous runs, slots rotate between the caller and the worker
+    struct AsyncJob {
+        ModelSlot* slot;
+        std::function<void(ModelSlot*)> completion;
+    };
+    int numSlots = 2;
+    std::vector<std::unique_ptr<ModelSlot>> slots;
+    std::vector<ModelSlot*> freeSlots;
+    std::deque<AsyncJob> asyncJobs;
+    std::mutex asyncMutex;
+    std::condition_variable slotReleased;
+    std::condition_variable jobQueued;
+    bool asyncStopping = false;
+    std::thread asyncWorker;
+
+    // Runs with a deadline
+    RunWatchdog watchdog;
+    Counter& terminated_runs = MetricsRegistry::instance().counter("model.terminated_runs");
+
+    // Optimized-model cache
+    // The first load serializes the optimized graph (ORT format) into the cache
+    // directory, later loads map that artifact and skip parsing/optimization.
+#if defined(USE_CUDA) || defined(USE_DML) || defined(USE_OpenVINO)
+    // Graphs optimized for these providers hold device specific nodes
+    // which cannot be serialized
+    bool useModelCache = false;
+#else
+    bool useModelCache = true;
+#endif
+    std::wstring modelCacheDirectory = L"assets/cache";
+
+    std::wstring modelPath;
+    std::atomic<bool> loaded{ false };
     
 public:
     std::vector<cv::Mat> preprocessedFrames;
@@ -102,7 +235,19 @@ private:
         session_options.SetGraphOptimizationLevel(ORT_DISABLE_ALL);
 #else
         //do nothing
-        session_options.SetGraphOptimizationLevel(GraphOptimizationLevel::ORT_ENABLE_ALL);
+        session_options.SetGraphOptimizationLevel(graphOptimizationLevel);
+#endif
+    }
+
+    const char* executionProviderName() {
+#if defined(USE_CUDA)
+        return "CUDA";
+#elif defined(USE_DML)
+        return "DML";
+#elif defined(USE_OpenVINO)
+        return "OpenVINO";
+#else
+        return "CPU";
 #endif
     }
 
@@ -115,11 +260,110 @@ private:
         return session_options;
     }
 
-    Ort::Session get_session(Ort::Env& env, const wchar_t* model_path, Ort::SessionOptions& session_options) {
-        Ort::Session session{ env, model_path, session_options };
+    // Everything that changes the optimized graph is part of the cache key.
+    // Thread counts do not, replicas with their own thread counts share one entry.
+    std::string sessionSignature() {
+        std::ostringstream signature;
+        signature << OrtGetApiBase()->GetVersionString()
+            << "|" << executionProviderName()
+            << "|" << graphOptimizationLevel;
+        return signature.str();
+    }
+
+    AssetSection modelSection() {
+        if (bundle)
+            return bundle->section(bundleSection);
+        return AssetSection();
+    }
+
+    // Model bytes come from the asset bundle when one is set, otherwise from modelPath
+    Ort::Session create_session(Ort::Env& env, Ort::SessionOptions& session_options) {
+        AssetSection section = modelSection();
+        if (section) {
+            Ort::Session session{ env, section.data, section.size, session_options };
+            return session;
+        }
+        Ort::Session session{ env, modelPath.c_str(), session_options };
+        return session;
+    }
+
+    // <cache dir>/<model name>.<hash(model bytes, session signature)>.ort
+    std::wstring get_cache_path() {
+        MappedFile model;
+        AssetSection section = modelSection();
+        std::wstring name;
+        if (section) {
+            name = std::wstring(bundleSection.begin(), bundleSection.end());
+        }
+        else {
+            if (!model.open(modelPath))
+                return std::wstring();
+            section.data = model.data();
+            section.size = model.size();
+
+            name = modelPath;
+            size_t separator = name.find_last_of(L"/\\");
+            if (separator != std::wstring::npos)
+                name = name.substr(separator + 1);
+            name = name.substr(0, name.find_last_of(L'.'));
+        }
+
+        uint64_t key = fnv1a_hash(section.data, section.size);
+        key = fnv1a_hash(sessionSignature(), key);
+
+        wchar_t keyHex[17];
+        swprintf_s(keyHex, L"%016llx", key);
+        return modelCacheDirectory + L"/" + name + L"." + keyHex + L".ort";
+    }
+
+    Ort::Session load_cached_session(Ort::Env& env) {
+        Ort::SessionOptions cached_options = get_sessionOptions();
+        cached_options.AddConfigEntry("session.load_model_format", "ORT");
+        // Reference the mapped bytes instead of copying them (ignored by older runtimes)
+        cached_options.AddConfigEntry("session.use_ort_model_bytes_directly", "1");
+        // The cached graph is already optimized
+        cached_options.SetGraphOptimizationLevel(GraphOptimizationLevel::ORT_DISABLE_ALL);
+        Ort::Session session{ env, cachedModel.data(), cachedModel.size(), cached_options };
+        return session;
+    }
+
+    Ort::Session create_cached_session(Ort::Env& env, const std::wstring& cachePath, Ort::SessionOptions& session_options) {
+        CreateDirectoryW(modelCacheDirectory.c_str(), NULL);
+
+        // Write to a temporary file first so a concurrently starting tracker
+        // never maps a partially written artifact
+        std::wstring tempPath = cachePath + L"." + std::to_wstring(GetCurrentProcessId()) + L".tmp";
+        session_options.AddConfigEntry("session.save_model_format", "ORT");
+        session_options.SetOptimizedModelFilePath(tempPath.c_str());
+
+        Ort::Session session = create_session(env, session_options);
+        if (!MoveFileExW(tempPath.c_str(), cachePath.c_str(), MOVEFILE_REPLACE_EXISTING)) {
+            DeleteFileW(tempPath.c_str());
+        }
         return session;
     }
 
+    Ort::Session get_session(Ort::Env& env, Ort::SessionOptions& session_options) {
+        if (useModelCache) {
+            std::wstring cachePath = get_cache_path();
+            if (!cachePath.empty()) {
+                if (cachedModel.open(cachePath)) {
+                    try {
+                        return load_cached_session(env);
+                    }
+                    catch (Ort::Exception e) {
+                        // Stale or corrupt artifact, rebuild it
+                        LOG_WARN("Discarding cached model: %s\n", e.what());
+                        cachedModel.close();
+                        DeleteFileW(cachePath.c_str());
+                    }
+                }
+                return create_cached_session(env, cachePath, session_options);
+            }
+        }
+        return create_session(env, session_options);
+    }
+
     void bindModelInputOutput(Ort::Session& session) {
 
         // Retrieve Input/Output Names
@@ -139,6 +383,14 @@ private:
             ONNXTensorElementDataType inputType = inputTensorInfo.GetElementType();
             std::vector<int64_t> inputDims = inputTensorInfo.GetShape();
 
+            // Dynamic dimensions (-1) are bound with size 1. A dynamic leading
+            // dimension means the model accepts batches (see runBatch)
+            dynamicBatch &= (!inputDims.empty() && inputDims[0] < 0);
+            for (auto& dim : inputDims) {
+                if (dim < 0)
+                    dim = 1;
+            }
+
             LOG_DEBUG("##########\n");
             for (std::string provider : Ort::GetAvailableProviders()) {
                 LOG_DEBUG("%s\n", provider.c_str());
@@ -172,6 +424,10 @@ private:
             Ort::TensorTypeAndShapeInfo outputTensorInfo = outputTypeInfo.GetTensorTypeAndShapeInfo();
             ONNXTensorElementDataType outputType = outputTensorInfo.GetElementType();
             std::vector<int64_t> outputDims = outputTensorInfo.GetShape();
+            for (auto& dim : outputDims) {
+                if (dim < 0)
+                    dim = 1;
+            }
 
             Output output;
             output.dims = outputDims; // set shape
@@ -190,21 +446,153 @@ private:
         }
     }
 
+    bool runSession(std::vector<Ort::Value>& inputValues, std::vector<Ort::Value>& outputValues, std::chrono::steady_clock::time_point deadline) {
+        bool watched = deadline != std::chrono::steady_clock::time_point::max();
+        Ort::RunOptions runOptions{ nullptr };
+        if (watched)
+            runOptions = Ort::RunOptions();
+        uint64_t watch = watched ? watchdog.watch(runOptions, deadline) : 0;
+        try {
+            session.Run(runOptions,
+                inputNames.data(), inputValues.data(), inputValues.size(),
+                outputNames.data(), outputValues.data(), outputValues.size());
+        }
+        catch (Ort::Exception e) {
+            // runs terminated by the watchdog are expected
+            if (watched && watchdog.unwatch(watch))
+                terminated_runs.add();
+            else
+                LOG_ERROR("%d: %s", e.GetOrtErrorCode(), e.what());
+            return false;
+        }
+        if (watched)
+            watchdog.unwatch(watch);
+        return true;
+    }
+
+    void createSlots() {
+        Ort::MemoryInfo memoryInfo = Ort::MemoryInfo::CreateCpu(
+            OrtAllocatorType::OrtArenaAllocator, OrtMemType::OrtMemTypeDefault);
+
+        for (int k = 0; k < numSlots; k++) {
+            auto slot = std::make_unique<ModelSlot>();
+            slot->inputs = inputs;
+            slot->outputs = outputs;
+            for (auto& input : slot->inputs) {
+                slot->inputTensors.push_back(Ort::Value::CreateTensor<float>(memoryInfo,
+                    input.values.data(), input.values.size(), input.dims.data(), input.dims.size()));
+            }
+            for (auto& output : slot->outputs) {
+                slot->outputTensors.push_back(Ort::Value::CreateTensor<float>(memoryInfo,
+                    output.values.data(), output.values.size(), output.dims.data(), output.dims.size()));
+            }
+            freeSlots.push_back(slot.get());
+            slots.push_back(std::move(slot));
+        }
+    }
+
+    void processAsyncJobs() {
+        TRACE_THREAD_NAME("model-async");
+        while (true) {
+            AsyncJob job;
+            {
+                std::unique_lock<std::mutex> lock(asyncMutex);
+                jobQueued.wait(lock, [this]() { return asyncStopping || !asyncJobs.empty(); });
+                if (asyncJobs.empty())
+                    return; // stopping
+                job = std::move(asyncJobs.front());
+                asyncJobs.pop_front();
+            }
+
+            TRACE_SCOPE("Model::runAsync");
+            ModelSlot* slot = job.slot;
+            for (size_t i = 0; i < slot->preprocessedFrames.size() && i < slot->inputs.size(); i++) {
+                // fill in place, the slot tensors point at these values
+                const cv::Mat& frame = slot->preprocessedFrames[i];
+                size_t count = std::min(slot->inputs[i].values.size(), frame.total() * frame.channels());
+                std::copy(frame.ptr<float>(), frame.ptr<float>() + count, slot->inputs[i].values.begin());
+            }
+            slot->cancelled = std::chrono::steady_clock::now() > slot->deadline
+                || !runSession(slot->inputTensors, slot->outputTensors, slot->deadline);
+            job.completion(slot);
+        }
+    }
+
 public:
-    Model(const wchar_t* modelFilepath) {
-        
+    // deferLoad postpones session creation until load() is called,
+    // e.g. from a StartupOrchestrator task
+    Model(const wchar_t* modelFilepath, bool deferLoad = false)
+        : modelPath{ modelFilepath }
+    {
+        if (!deferLoad)
+            load();
+    }
+
+    // Creates the session from an in-memory section of a mapped asset bundle
+    Model(std::shared_ptr<AssetBundle> assetBundle, const std::string& section, bool deferLoad = false)
+        : bundle{ assetBundle }, bundleSection{ section }
+    {
+        if (!deferLoad)
+            load();
+    }
+
+    // Switches a deferred model to an asset bundle section, call before load()
+    bool useAssetBundle(std::shared_ptr<AssetBundle> assetBundle, const std::string& section) {
+        if (loaded || !assetBundle || !assetBundle->section(section))
+            return false;
+        bundle = assetBundle;
+        bundleSection = section;
+        return true;
+    }
+
+    // Thread pools of the session, call before load()
+    bool setThreadCounts(int intraOpThreads, int interOpThreads) {
+        if (loaded)
+            return false;
+        numIntraOpsThreads = intraOpThreads;
+        numInterOpsThreads = interOpThreads;
+        return true;
+    }
+
+    // Number of buffer sets for runAsync (2 = double buffering), call before load()
+    bool setSlotCount(int count) {
+        if (loaded)
+            return false;
+        numSlots = std::max(1, count);
+        return true;
+    }
+
+    void load() {
+        if (loaded)
+            return;
+
         // Load model from filepath and create session 
         Ort::SessionOptions session_options = get_sessionOptions();
-        session = get_session(env, modelFilepath, session_options);
+        session = get_session(env, session_options);
 
         // Define Input/Output (name, tensors, dim) 
         bindModelInputOutput(session);
+        createSlots();
+        loaded = true;
 
         // Cleanup 
         session_options.release();
     }
 
+    bool isLoaded() {
+        return loaded;
+    }
+
     ~Model() {
+        // Queued async runs finish before the session goes away
+        {
+            std::lock_guard<std::mutex> lock(asyncMutex);
+            asyncStopping = true;
+        }
+        jobQueued.notify_all();
+        if (asyncWorker.joinable())
+            asyncWorker.join();
+
         // Cleanup ORT memory variables here
         env.release();
         session.release();
@@ -220,14 +608,160 @@ public:
     }
 
     void run() {
+        TRACE_SCOPE("Model::run");
+        runSession(inputTensors, outputTensors, std::chrono::steady_clock::time_point::max());
+    }
+
+    // False when the run failed or was terminated at the deadline, outputs are not valid then
+    bool run(std::chrono::steady_clock::time_point deadline) {
+        TRACE_SCOPE("Model::run");
+        return runSession(inputTensors, outputTensors, deadline);
+    }
+
+    // Blocks until a buffer set is free. The caller owns it until it is
+    // passed to runAsync().
+    ModelSlot* acquireSlot() {
+        std::unique_lock<std::mutex> lock(asyncMutex);
+        slotReleased.wait(lock, [this]() { return !freeSlots.empty(); });
+        ModelSlot* slot = freeSlots.back();
+        freeSlots.pop_back();
+        return slot;
+    }
+
+    // Hands a slot back after the results of a future-based runAsync() are read
+    void releaseSlot(ModelSlot* slot) {
+        {
+            std::lock_guard<std::mutex> lock(asyncMutex);
+            freeSlots.push_back(slot);
+        }
+        slotReleased.notify_all();
+    }
+
+    /*
+    * Runs slot->preprocessedFrames on the worker thread and calls completion
+    * with the slot when slot->outputs is filled. The slot is released when
+    * completion returns, so it must not be used afterwards. Runs complete in
+    * submission order.
+    */
+    void runAsync(ModelSlot* slot, std::function<void(ModelSlot*)> completion) {
+        {
+            std::lock_guard<std::mutex> lock(asyncMutex);
+            if (!asyncWorker.joinable())
+                asyncWorker = std::thread(&Model::processAsyncJobs, this);
+            asyncJobs.push_back({ slot, [this, completion](ModelSlot* done) {
+                completion(done);
+                releaseSlot(done);
+            } });
+        }
+        jobQueued.notify_one();
+    }
+
+    // Blocks until every callback-based runAsync() has completed
+    void waitForAsyncRuns() {
+        std::unique_lock<std::mutex> lock(asyncMutex);
+        slotReleased.wait(lock, [this]() { return freeSlots.size() == slots.size(); });
+    }
+
+    // Future-based variant, the caller keeps owning the slot until releaseSlot()
+    std::future<ModelSlot*> runAsync(ModelSlot* slot) {
+        auto done = std::make_shared<std::promise<ModelSlot*>>();
+        std::future<ModelSlot*> result = done->get_future();
+        {
+            std::lock_guard<std::mutex> lock(asyncMutex);
+            if (!asyncWorker.joinable())
+                asyncWorker = std::thread(&Model::processAsyncJobs, this);
+            asyncJobs.push_back({ slot, [done](ModelSlot* completed) { done->set_value(completed); } });
+        }
+        jobQueued.notify_one();
+        return result;
+    }
+
+    /*
+    * Runs all samples with a single session.Run when the model has a dynamic
+    * batch dimension, otherwise falls back to one run per sample.
+    * batchFrames[n][i] is the preprocessed (CHW) frame of input i for sample n.
+    * batchOutputs[o].values holds output o of every sample back to back.
+    * False when a run failed or was terminated at the deadline, batchOutputs
+    * are not valid then.
+    */
+    bool runBatch(const std::vector<std::vector<cv::Mat>>& batchFrames, std::vector<Output>& batchOutputs,
+        std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max()) {
+        TRACE_SCOPE("Model::runBatch");
+        const int64_t batchSize = batchFrames.size();
+        batchOutputs.resize(outputs.size());
+        for (size_t o = 0; o < outputs.size(); o++) {
+            batchOutputs[o].name = outputs[o].name;
+            batchOutputs[o].dims = outputs[o].dims;
+            batchOutputs[o].dims[0] = batchSize;
+            batchOutputs[o].values.clear();
+        }
+        if (batchSize == 0)
+            return true;
+
+        // Without a dynamic batch dimension every sample is a batch of one.
+        // Either way the inputs are packed into batchInputValues, so the
+        // members used by run() and runAsync() are left alone.
+        if (!dynamicBatch) {
+            for (int64_t n = 0; n < batchSize; n++) {
+                if (!runPacked(batchFrames, n, 1, batchOutputs, deadline))
+                    return false;
+            }
+            return true;
+        }
+        return runPacked(batchFrames, 0, batchSize, batchOutputs, deadline);
+    }
+
+private:
+    // Runs samples [first, first + count) as one batch, appends their outputs to batchOutputs
+    bool runPacked(const std::vector<std::vector<cv::Mat>>& batchFrames, int64_t first, int64_t count,
+        std::vector<Output>& batchOutputs, std::chrono::steady_clock::time_point deadline) {
+        Ort::MemoryInfo memoryInfo = Ort::MemoryInfo::CreateCpu(
+            OrtAllocatorType::OrtArenaAllocator, OrtMemType::OrtMemTypeDefault);
+
+        // Pack the samples of each input back to back (NCHW)
+        std::vector<Ort::Value> batchTensors;
+        batchInputValues.resize(inputs.size());
+        for (size_t i = 0; i < inputs.size(); i++) {
+            std::vector<int64_t> dims = inputs[i].dims;
+            dims[0] = count;
+            size_t sampleSize = inputs[i].values.size();
+            std::vector<float>& values = batchInputValues[i];
+            values.assign(sampleSize * count, 0.0f);
+            for (int64_t n = 0; n < count; n++) {
+                const cv::Mat& frame = batchFrames[first + n][i];
+                size_t frameSize = std::min(sampleSize, frame.total() * frame.channels());
+                std::copy(frame.ptr<float>(), frame.ptr<float>() + frameSize, values.begin() + n * sampleSize);
+            }
+            batchTensors.push_back(Ort::Value::CreateTensor<float>(memoryInfo,
+                values.data(), values.size(), dims.data(), dims.size()));
+        }
+
+        // same watchdog as runSession(), the batch outputs are allocated by the run
+        bool watched = deadline != std::chrono::steady_clock::time_point::max();
+        Ort::RunOptions runOptions{ nullptr };
+        if (watched)
+            runOptions = Ort::RunOptions();
+        uint64_t watch = watched ? watchdog.watch(runOptions, deadline) : 0;
         try {
-            session.Run(Ort::RunOptions{ nullptr },
-                inputNames.data(), inputTensors.data(), inputTensors.size(),
-                outputNames.data(), outputTensors.data(), outputTensors.size());
+            std::vector<Ort::Value> results = session.Run(runOptions,
+                inputNames.data(), batchTensors.data(), batchTensors.size(),
+                outputNames.data(), outputNames.size());
+            for (size_t o = 0; o < results.size(); o++) {
+                const float* data = results[o].GetTensorMutableData<float>();
+                size_t elements = results[o].GetTensorTypeAndShapeInfo().GetElementCount();
+                batchOutputs[o].values.insert(batchOutputs[o].values.end(), data, data + elements);
+            }
         }
         catch (Ort::Exception e) {
-            LOG_ERROR("%d: %s", e.GetOrtErrorCode(), e.what());
+            if (watched && watchdog.unwatch(watch))
+                terminated_runs.add();
+            else
+                LOG_ERROR("%d: %s", e.GetOrtErrorCode(), e.what());
+            return false;
         }
+        if (watched)
+            watchdog.unwatch(watch);
+        return true;
     }
 
 };
@@ -0,0 +1,89 @@
+#pragma once
+#include "framework.h"
+
+struct MotionGateConfig {
+    bool enabled = true;
+    int signature_size = 16;                // side of the downsampled luma signature
+    double max_pixel_change = 0.012;        // mean absolute luma change (0..1) of any ROI
+    double max_landmark_shift = 0.01;       // mean landmark shift in face widths
+    std::chrono::milliseconds max_reuse_age{ 250 }; // infer at least this often
+};
+
+
+/*
+* Decides whether a frame can reuse the gaze of the last inferred frame.
+* observe() keeps tiny luma signatures of the ROI crops and the landmarks,
+* is_static() compares them with those of the last inferred frame (not the
+* previous frame, so slow drift still triggers inference).
+*/
+class MotionGate {
+private:
+    MotionGateConfig config;
+    std::vector<cv::Mat> current, reference;
+    std::vector<cv::Point2f> current_landmarks, reference_landmarks;
+    float current_face_width = 0;
+    cv::Mat luma;
+
+    bool has_reference = false;
+    uint64_t reference_frame = 0;
+    std::chrono::steady_clock::time_point reference_time;
+
+public:
+    MotionGate() {}
+
+    void configure(const MotionGateConfig& gateConfig) {
+        config = gateConfig;
+        has_reference = false;
+    }
+
+    bool enabled() const {
+        return config.enabled;
+    }
+
+    // roi_images are the HWC float YCbCr crops, luma is channel 0
+    void observe(const std::vector<cv::Mat>& roi_images, const std::vector<cv::Point2f>& landmarks) {
+        current.resize(roi_images.size());
+        for (size_t i = 0; i < roi_images.size(); i++) {
+            cv::extractChannel(roi_images[i], luma, 0);
+            cv::resize(luma, current[i], cv::Size(config.signature_size, config.signature_size), 0, 0, cv::INTER_AREA);
+        }
+        current_landmarks.assign(landmarks.begin(), landmarks.end());
+        current_face_width = landmarks.empty() ? 0 : (float)cv::boundingRect(landmarks).width;
+    }
+
+    bool is_static(std::chrono::steady_clock::time_point now) const {
+        if (!has_reference || now - reference_time > config.max_reuse_age)
+            return false;
+        if (current.size() != reference.size() || current_landmarks.size() != reference_landmarks.size())
+            return false;
+
+        for (size_t i = 0; i < current.size(); i++) {
+            double change = cv::norm(current[i], reference[i], cv::NORM_L1) / current[i].total();
+            if (change > config.max_pixel_change)
+                return false;
+        }
+
+        if (!current_landmarks.empty() && current_face_width > 0) {
+            double shift = 0;
+            for (size_t i = 0; i < current_landmarks.size(); i++) {
+                shift += cv::norm(current_landmarks[i] - reference_landmarks[i]);
+            }
+            if (shift / current_landmarks.size() / current_face_width > config.max_landmark_shift)
+                return false;
+        }
+        return true;
+    }
+
+    // The observed frame goes to inference and becomes the reference
+    void mark_inferred(uint64_t frame_id, std::chrono::steady_clock::time_point now) {
+        std::swap(current, reference);
+        std::swap(current_landmarks, reference_landmarks);
+        reference_frame = frame_id;
+        reference_time = now;
+        has_reference = true;
+    }
+
+    uint64_t reference_frame_id() const {
+        return reference_frame;
+    }
+};
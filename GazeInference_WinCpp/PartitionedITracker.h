@@ -0,0 +1,159 @@
+#pragma once
+#include "Model.h"
+#include "Metrics.h"
+
+struct PartitionConfig {
+    bool enabled = true;
+    double max_face_shift = 0.05;   // face rect center shift, in face widths
+    double max_face_scale = 0.05;   // relative change of the face width
+    std::chrono::milliseconds max_feature_age{ 500 }; // lighting and expression drift
+};
+
+
+/*
+* ITracker split in two graphs next to the monolithic model:
+*   itracker_face.onnx  inputs (face, face grid) -> face features
+*   itracker_eyes.onnx  inputs (left eye, right eye, face features) -> gaze
+* Eye-model inputs named like a face-model output get those features, the
+* others take the eye crops in order. The face features are cached and only
+* recomputed when the face rect moves or scales, or they get too old, so
+* most frames only run the eye branches.
+*/
+class PartitionedITracker {
+private:
+    PartitionConfig config;
+    std::unique_ptr<Model> face_model;
+    std::unique_ptr<Model> eye_model;
+    std::vector<int> feature_source; // per eye-model input: face-model output, or -1 for an eye crop
+
+    bool has_features = false;
+    cv::Rect feature_face;
+    std::chrono::steady_clock::time_point feature_time;
+
+    Counter& face_runs = MetricsRegistry::instance().counter("partition.face_runs");
+    Counter& face_reused = MetricsRegistry::instance().counter("partition.face_reused");
+
+    // ROI order of DlibFaceDetector::ROIExtraction
+    enum ROI { FACE = 0, LEFT_EYE = 1, RIGHT_EYE = 2, FACE_GRID = 3 };
+
+    static void fill(Input& input, const cv::Mat& frame) {
+        // in place, the session tensors point at these values
+        size_t count = std::min(input.values.size(), frame.total() * frame.channels());
+        std::copy(frame.ptr<float>(), frame.ptr<float>() + count, input.values.begin());
+    }
+
+    static void fill(Input& input, const Output& features) {
+        size_t count = std::min(input.values.size(), features.values.size());
+        std::copy(features.values.begin(), features.values.begin() + count, input.values.begin());
+    }
+
+    bool bind() {
+        if (face_model->inputs.size() != 2) {
+            LOG_ERROR("Face partition expects 2 inputs, has %zu\n", face_model->inputs.size());
+            return false;
+        }
+
+        int eye_inputs = 0, feature_inputs = 0;
+        feature_source.clear();
+        for (auto& input : eye_model->inputs) {
+            int source = -1;
+            for (size_t o = 0; o < face_model->outputs.size(); o++) {
+                if (strcmp(input.name, face_model->outputs[o].name) == 0)
+                    source = (int)o;
+            }
+            feature_source.push_back(source);
+            (source < 0 ? eye_inputs : feature_inputs)++;
+        }
+        if (eye_inputs != 2 || feature_inputs == 0 || eye_model->outputs.empty()) {
+            LOG_ERROR("Eye partition expects 2 eye inputs and the face features, has %d and %d\n", eye_inputs, feature_inputs);
+            return false;
+        }
+        return true;
+    }
+
+    bool face_changed(cv::Rect face, std::chrono::steady_clock::time_point now) const {
+        if (!has_features || now - feature_time > config.max_feature_age || feature_face.width <= 0)
+            return true;
+        cv::Point2f shift = (cv::Point2f)(face.tl() + face.br() - feature_face.tl() - feature_face.br()) * 0.5f;
+        double width = feature_face.width;
+        return cv::norm(shift) / width > config.max_face_shift
+            || std::abs(face.width - feature_face.width) / width > config.max_face_scale;
+    }
+
+public:
+    PartitionedITracker(const std::wstring& modelPath, const PartitionConfig& partitionConfig = PartitionConfig())
+        : config{ partitionConfig }
+    {
+        face_model = std::make_unique<Model>(partition_path(modelPath, L"_face").c_str(), true);
+        eye_model = std::make_unique<Model>(partition_path(modelPath, L"_eyes").c_str(), true);
+    }
+
+    // itracker.onnx -> itracker<suffix>.onnx
+    static std::wstring partition_path(const std::wstring& modelPath, const wchar_t* suffix) {
+        size_t dot = modelPath.find_last_of(L'.');
+        size_t slash = modelPath.find_last_of(L"/\\");
+        if (dot == std::wstring::npos || (slash != std::wstring::npos && dot < slash))
+            return modelPath + suffix;
+        return modelPath.substr(0, dot) + suffix + modelPath.substr(dot);
+    }
+
+    static bool available(const std::wstring& modelPath) {
+        return GetFileAttributesW(partition_path(modelPath, L"_face").c_str()) != INVALID_FILE_ATTRIBUTES
+            && GetFileAttributesW(partition_path(modelPath, L"_eyes").c_str()) != INVALID_FILE_ATTRIBUTES;
+    }
+
+    // False when the graphs do not fit together, use the monolithic model then
+    bool load() {
+        try {
+            face_model->load();
+            eye_model->load();
+        }
+        catch (const Ort::Exception& e) {
+            LOG_ERROR("%d: %s\n", e.GetOrtErrorCode(), e.what());
+            return false;
+        }
+        return bind();
+    }
+
+    void invalidate() {
+        has_features = false;
+    }
+
+    /*
+    * frames are the preprocessed (CHW) ROIs, face the face rect in camera
+    * pixels. False when a run failed or was terminated at the deadline, gaze
+    * is not set then.
+    */
+    bool infer(const std::vector<cv::Mat>& frames, cv::Rect face, std::chrono::steady_clock::time_point now,
+        std::chrono::steady_clock::time_point deadline, cv::Point2f& gaze) {
+        TRACE_SCOPE("PartitionedITracker::infer");
+        if (face_changed(face, now)) {
+            fill(face_model->inputs[0], frames[ROI::FACE]);
+            fill(face_model->inputs[1], frames[ROI::FACE_GRID]);
+            if (!face_model->run(deadline)) {
+                has_features = false;
+                return false;
+            }
+            has_features = true;
+            feature_face = face;
+            feature_time = now;
+            face_runs.add();
+        }
+        else {
+            face_reused.add();
+        }
+
+        int eye = ROI::LEFT_EYE;
+        for (size_t i = 0; i < eye_model->inputs.size(); i++) {
+            if (feature_source[i] < 0)
+                fill(eye_model->inputs[i], frames[eye++]);
+            else
+                fill(eye_model->inputs[i], face_model->outputs[feature_source[i]]);
+        }
+        if (!eye_model->run(deadline))
+            return false;
+        const std::vector<float>& values = eye_model->outputs[0].values;
+        gaze = cv::Point2f(values[0], values[1]);
+        return true;
+    }
+};
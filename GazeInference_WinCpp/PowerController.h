@@ -0,0 +1,100 @@
+#pragma once
+#include "framework.h"
+#include "Metrics.h"
+#include <ctime>
+
+enum POWER_MODE { FULL_POWER, LOW_POWER };
+
+struct PowerConfig {
+    bool enabled = true;
+    std::chrono::milliseconds idle_after{ 2000 };           // without a face
+    int idle_frame_rate = 5;
+    cv::Size idle_resolution = cv::Size(640, 480);
+    int idle_detect_interval = 1;                           // few idle frames, detect on each
+    std::chrono::milliseconds idle_frame_interval{ 200 };   // for cameras ignoring the frame rate
+};
+
+
+/*
+* Duty cycle of the pipeline by user presence. After idle_after without a
+* face the camera and detector are backed off and frames are processed at
+* most every idle_frame_interval. The first face found switches back at once.
+*/
+class PowerController {
+private:
+    PowerConfig config;
+    int mode = POWER_MODE::FULL_POWER;
+    std::chrono::steady_clock::time_point last_presence = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point next_idle_frame;
+
+    Gauge& idle = MetricsRegistry::instance().gauge("power.idle");
+    Counter& mode_changes = MetricsRegistry::instance().counter("power.mode_changes");
+
+    static const char* mode_name(int powerMode) {
+        return powerMode == POWER_MODE::LOW_POWER ? "low" : "full";
+    }
+
+    void log_change(int from, int to, std::chrono::steady_clock::time_point now) {
+        auto wall = std::chrono::system_clock::now();
+        std::time_t seconds = std::chrono::system_clock::to_time_t(wall);
+        int millis = (int)(std::chrono::duration_cast<std::chrono::milliseconds>(wall.time_since_epoch()).count() % 1000);
+        std::tm local;
+        localtime_s(&local, &seconds);
+        char time[16];
+        strftime(time, sizeof(time), "%H:%M:%S", &local);
+        LOG_DEBUG("%s.%03d Power mode %s -> %s (last face %lld ms ago)\n", time, millis, mode_name(from), mode_name(to),
+            (long long)std::chrono::duration_cast<std::chrono::milliseconds>(now - last_presence).count());
+    }
+
+public:
+    PowerController() {}
+
+    void configure(const PowerConfig& powerConfig) {
+        config = powerConfig;
+    }
+
+    const PowerConfig& configuration() const {
+        return config;
+    }
+
+    bool enabled() const {
+        return config.enabled;
+    }
+
+    int current_mode() const {
+        return mode;
+    }
+
+    // True when the mode changed, the caller then applies current_mode()
+    bool update(bool face_found, std::chrono::steady_clock::time_point now) {
+        int next = mode;
+        if (face_found)
+            next = POWER_MODE::FULL_POWER;
+        else if (now - last_presence > config.idle_after)
+            next = POWER_MODE::LOW_POWER;
+
+        bool changed = next != mode;
+        if (changed) {
+            log_change(mode, next, now);
+            mode = next;
+            mode_changes.add();
+            idle.set(mode == POWER_MODE::LOW_POWER);
+            next_idle_frame = now;
+        }
+        if (face_found)
+            last_presence = now;
+        return changed;
+    }
+
+    // Sleeps out the rest of the idle frame interval, no-op while active
+    void throttle() {
+        if (mode != POWER_MODE::LOW_POWER)
+            return;
+        next_idle_frame += config.idle_frame_interval;
+        auto now = std::chrono::steady_clock::now();
+        if (next_idle_frame < now)
+            next_idle_frame = now;
+        else
+            std::this_thread::sleep_until(next_idle_frame);
+    }
+};
@@ -0,0 +1,82 @@
+#pragma once
+#include "framework.h"
+
+struct SearchWindowConfig {
+    bool enabled = true;
+    double margin = 0.5;            // around the last face, in face widths
+    double velocity_gain = 2.0;     // extra margin per pixel of motion between detections
+    int full_sweep_interval = 15;   // detections between full-frame sweeps
+    int window_face_size = 100;     // face width the dlib detector gets, in pixels
+};
+
+
+/*
+* Predicts where the primary face is searched next: the last detected face
+* rect, shifted by its velocity and grown by a margin that widens with the
+* motion. Every full_sweep_interval detections, and whenever the face was
+* lost, the whole frame is searched so new or re-entering faces are found.
+*/
+class SearchWindow {
+private:
+    SearchWindowConfig config;
+    bool tracking = false;
+    cv::Rect face;
+    cv::Point2f velocity;           // face center motion per detection
+    int detections_since_sweep = 0;
+
+    static cv::Point2f center(const cv::Rect& rect) {
+        return cv::Point2f(rect.x + rect.width * 0.5f, rect.y + rect.height * 0.5f);
+    }
+
+public:
+    SearchWindow() {}
+
+    void configure(const SearchWindowConfig& windowConfig) {
+        config = windowConfig;
+        reset();
+    }
+
+    bool enabled() const {
+        return config.enabled;
+    }
+
+    void reset() {
+        tracking = false;
+        velocity = cv::Point2f();
+    }
+
+    // Region to search in the next detection, empty for a full-frame sweep
+    cv::Rect next(cv::Size frameSize) {
+        if (!config.enabled || !tracking || ++detections_since_sweep >= config.full_sweep_interval) {
+            detections_since_sweep = 0;
+            return cv::Rect();
+        }
+
+        cv::Point2f predicted = center(face) + velocity;
+        double margin = config.margin * face.width + config.velocity_gain * cv::norm(velocity);
+        cv::Size2f size(face.width + 2 * margin, face.height + 2 * margin);
+        cv::Rect window(cv::Point((int)(predicted.x - size.width / 2), (int)(predicted.y - size.height / 2)),
+            cv::Size((int)size.width, (int)size.height));
+        window &= cv::Rect(cv::Point(0, 0), frameSize);
+        if (window.area() * 2 >= frameSize.area())
+            return cv::Rect(); // hardly cheaper than a sweep
+        return window;
+    }
+
+    // Downscaling of the window for detectors that scan at the image scale
+    double scale() const {
+        return std::min(1.0, config.window_face_size / (double)std::max(1, face.width));
+    }
+
+    // Faces of the last detection, window or sweep, in frame coordinates
+    void update(const std::vector<cv::Rect>& faces) {
+        if (faces.size() != 1) {
+            reset();
+            return;
+        }
+        if (tracking)
+            velocity = 0.5f * velocity + 0.5f * (center(faces[0]) - center(face));
+        face = faces[0];
+        tracking = true;
+    }
+};
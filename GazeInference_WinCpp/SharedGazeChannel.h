@@ -0,0 +1,228 @@
+#pragma once
+#include <windows.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+/*
+* Gaze samples in a named shared-memory ring, one writer (the tracker) and
+* any number of readers in other processes. Every slot is a seqlock: readers
+* copy the record and retry if the writer touched it meanwhile, so neither
+* side ever waits on the other or makes a syscall per sample.
+*
+* Only depends on Windows and the standard library, consumers can include
+* this header on its own.
+*/
+
+#define SHARED_GAZE_CHANNEL_NAME "Local\\GazeInference.Gaze"
+
+struct SharedGazeRecord {
+    uint64_t frame_id;
+    int64_t capture_ns;     // steady_clock (QueryPerformanceCounter), same clock in every process
+    int64_t publish_ns;
+    float raw_x, raw_y;     // screen coordinates before calibration
+    float x, y;             // published screen coordinates
+    float confidence;       // 0..1
+    int32_t face_x, face_y, face_width, face_height; // camera pixels
+};
+
+struct SharedGazeSlot {
+    std::atomic<uint32_t> sequence; // odd while the writer is in the slot, 0 before the first write
+    uint32_t reserved;
+    uint64_t index;                 // of the record in the slot, written inside the seqlock
+    SharedGazeRecord record;
+};
+
+struct SharedGazeHeader {
+    static const uint32_t MAGIC = 0x5A41474D; // "MGAZ"
+    static const uint32_t VERSION = 2;
+
+    uint32_t magic;
+    uint32_t version;
+    uint32_t capacity;
+    uint32_t slot_size;
+    std::atomic<uint64_t> written; // records published so far
+};
+
+inline int64_t shared_gaze_now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+class SharedGazeMapping {
+protected:
+    HANDLE mapping = NULL;
+    unsigned char* view = nullptr;
+    SharedGazeHeader* header = nullptr;
+    SharedGazeSlot* slots = nullptr;
+
+    static size_t mapping_size(uint32_t capacity) {
+        return sizeof(SharedGazeHeader) + (size_t)capacity * sizeof(SharedGazeSlot);
+    }
+
+    bool map(DWORD access) {
+        view = (unsigned char*)MapViewOfFile(mapping, access, 0, 0, 0);
+        if (!view)
+            return false;
+        header = (SharedGazeHeader*)view;
+        slots = (SharedGazeSlot*)(view + sizeof(SharedGazeHeader));
+        return true;
+    }
+
+public:
+    SharedGazeMapping() {}
+
+    ~SharedGazeMapping() {
+        close();
+    }
+
+    SharedGazeMapping(const SharedGazeMapping&) = delete;
+    SharedGazeMapping& operator=(const SharedGazeMapping&) = delete;
+
+    void close() {
+        if (view)
+            UnmapViewOfFile(view);
+        if (mapping)
+            CloseHandle(mapping);
+        view = nullptr;
+        mapping = NULL;
+        header = nullptr;
+        slots = nullptr;
+    }
+
+    bool is_open() const {
+        return header != nullptr;
+    }
+};
+
+
+class SharedGazeWriter : public SharedGazeMapping {
+public:
+    bool create(const std::string& name = SHARED_GAZE_CHANNEL_NAME, uint32_t capacity = 256) {
+        close();
+        size_t size = mapping_size(capacity);
+        mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, (DWORD)((uint64_t)size >> 32), (DWORD)size, name.c_str());
+        bool existed = GetLastError() == ERROR_ALREADY_EXISTS;
+        if (!mapping || !map(FILE_MAP_ALL_ACCESS)) {
+            close();
+            return false;
+        }
+
+        // An existing mapping keeps its original size, use only the slots that fit
+        if (existed) {
+            MEMORY_BASIC_INFORMATION region;
+            if (VirtualQuery(view, &region, sizeof(region)) == 0 || region.RegionSize < mapping_size(1)) {
+                close();
+                return false;
+            }
+            uint32_t fitting = (uint32_t)(std::min<size_t>)((region.RegionSize - sizeof(SharedGazeHeader)) / sizeof(SharedGazeSlot), UINT32_MAX);
+            capacity = (std::min)(capacity, fitting);
+        }
+
+        // Fresh mappings are zeroed; an existing one is reset for this writer
+        header->written.store(0, std::memory_order_relaxed);
+        for (uint32_t i = 0; i < capacity; i++) {
+            slots[i].sequence.store(0, std::memory_order_relaxed);
+        }
+        header->capacity = capacity;
+        header->slot_size = sizeof(SharedGazeSlot);
+        header->version = SharedGazeHeader::VERSION;
+        std::atomic_thread_fence(std::memory_order_release);
+        header->magic = SharedGazeHeader::MAGIC;
+        return true;
+    }
+
+    void write(const SharedGazeRecord& record) {
+        uint64_t index = header->written.load(std::memory_order_relaxed);
+        SharedGazeSlot& slot = slots[index % header->capacity];
+        uint32_t sequence = slot.sequence.load(std::memory_order_relaxed);
+        slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slot.index = index;
+        slot.record = record;
+        slot.sequence.store(sequence + 2, std::memory_order_release);
+        header->written.store(index + 1, std::memory_order_release);
+    }
+};
+
+
+class SharedGazeReader : public SharedGazeMapping {
+public:
+    bool open(const std::string& name = SHARED_GAZE_CHANNEL_NAME) {
+        close();
+        mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, name.c_str());
+        if (!mapping || !map(FILE_MAP_READ)) {
+            close();
+            return false;
+        }
+        if (header->magic != SharedGazeHeader::MAGIC || header->version != SharedGazeHeader::VERSION
+            || header->slot_size != sizeof(SharedGazeSlot)) {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    // Number of records published so far, the next one gets this index
+    uint64_t written() const {
+        return header->written.load(std::memory_order_acquire);
+    }
+
+    // False if index is not published yet or was already overwritten
+    bool read(uint64_t index, SharedGazeRecord& record) const {
+        const SharedGazeSlot& slot = slots[index % header->capacity];
+        for (int attempt = 0; attempt < 64; attempt++) {
+            uint32_t before = slot.sequence.load(std::memory_order_acquire);
+            if (before == 0)
+                return false; // never written
+            if (before & 1)
+                continue;
+            uint64_t copy_index = slot.index;
+            SharedGazeRecord copy = slot.record;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            uint32_t after = slot.sequence.load(std::memory_order_relaxed);
+            if (before != after)
+                continue;
+
+            // the slot holds an earlier or a later lap
+            if (copy_index != index)
+                return false;
+            record = copy;
+            return true;
+        }
+        return false;
+    }
+
+    bool read_latest(SharedGazeRecord& record, uint64_t* index = nullptr) const {
+        uint64_t count = written();
+        if (count == 0)
+            return false;
+        if (index)
+            *index = count - 1;
+        return read(count - 1, record);
+    }
+
+    /*
+    * Calls handler for every record after cursor and advances it. Records
+    * overwritten before they were read are skipped, returns how many.
+    */
+    template <typename Handler>
+    uint64_t read_new(uint64_t& cursor, Handler handler) const {
+        uint64_t count = written();
+        uint64_t lost = 0;
+        if (count - cursor > header->capacity) {
+            lost = count - header->capacity - cursor;
+            cursor = count - header->capacity;
+        }
+        SharedGazeRecord record;
+        for (; cursor < count; cursor++) {
+            if (read(cursor, record))
+                handler(record);
+            else
+                lost++;
+        }
+        return lost;
+    }
+};
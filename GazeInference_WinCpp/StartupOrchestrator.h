@@ -0,0 +1,111 @@
+#pragma once
+#include "framework.h"
+#include <functional>
+
+
+struct StartupTiming {
+    std::string name;
+    double start_ms = 0;    // relative to the orchestrator epoch
+    double duration_ms = 0;
+    bool ready = false;
+};
+
+/*
+* Runs independent initialization steps (ONNX sessions, landmark predictor,
+* camera, ...) concurrently. Each step gets a readiness future so callers can
+* wait for exactly what they need, and the timing report shows which
+* component bounds time-to-first-gaze.
+*/
+class StartupOrchestrator {
+private:
+    struct Component {
+        StartupTiming timing;
+        std::shared_future<bool> ready;
+    };
+
+    std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+    double wall_ms = 0;
+    // unique_ptr keeps the timing addresses stable for the worker threads
+    std::vector<std::unique_ptr<Component>> components;
+
+    double elapsed_ms(std::chrono::steady_clock::time_point time) {
+        return std::chrono::duration<double, std::milli>(time - epoch).count();
+    }
+
+public:
+    StartupOrchestrator() {}
+
+    ~StartupOrchestrator() {
+        // Never leave a task running against a destroyed orchestrator
+        wait_all();
+    }
+
+    std::shared_future<bool> launch(const std::string& name, std::function<bool()> task) {
+        components.push_back(std::make_unique<Component>());
+        Component* component = components.back().get();
+        component->timing.name = name;
+
+        component->ready = std::async(std::launch::async, [this, component, task]() {
+            auto begin = std::chrono::steady_clock::now();
+            bool status = false;
+            try {
+                status = task();
+            }
+            catch (const std::exception& e) {
+                LOG_ERROR("Startup of %s failed: %s\n", component->timing.name.c_str(), e.what());
+            }
+            auto end = std::chrono::steady_clock::now();
+            component->timing.start_ms = elapsed_ms(begin);
+            component->timing.duration_ms = std::chrono::duration<double, std::milli>(end - begin).count();
+            component->timing.ready = status;
+            return status;
+        }).share();
+
+        return component->ready;
+    }
+
+    std::shared_future<bool> ready(const std::string& name) {
+        for (auto& component : components) {
+            if (component->timing.name == name)
+                return component->ready;
+        }
+        return std::shared_future<bool>();
+    }
+
+    // Blocks until every component finished, returns true if all succeeded
+    bool wait_all() {
+        bool status = true;
+        for (auto& component : components) {
+            status &= component->ready.get();
+        }
+        wall_ms = elapsed_ms(std::chrono::steady_clock::now());
+        return status;
+    }
+
+    std::vector<StartupTiming> timings() {
+        std::vector<StartupTiming> result;
+        for (auto& component : components) {
+            result.push_back(component->timing);
+        }
+        return result;
+    }
+
+    // Call after wait_all()
+    void report() {
+        double sum_ms = 0;
+        double critical_ms = 0;
+        std::string critical_name = "none";
+        for (auto& component : components) {
+            const StartupTiming& timing = component->timing;
+            LOG_DEBUG("[startup] %-20s start %8.1f ms | duration %8.1f ms | %s\n",
+                timing.name.c_str(), timing.start_ms, timing.duration_ms, timing.ready ? "ready" : "FAILED");
+            sum_ms += timing.duration_ms;
+            if (timing.start_ms + timing.duration_ms > critical_ms) {
+                critical_ms = timing.start_ms + timing.duration_ms;
+                critical_name = timing.name;
+            }
+        }
+        LOG_DEBUG("[startup] wall %.1f ms | sequential sum %.1f ms | slowest %s\n",
+            wall_ms, sum_ms, critical_name.c_str());
+    }
+};
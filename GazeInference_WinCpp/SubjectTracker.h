@@ -0,0 +1,73 @@
+#pragma once
+#include "framework.h"
+
+
+struct TrackedSubject {
+    int id;
+    cv::Rect face;
+    int last_seen;
+};
+
+/*
+* Assigns stable identities to the faces detected in consecutive frames by
+* greedy IoU matching against the faces of the previous frames.
+*/
+class SubjectTracker {
+private:
+    std::vector<TrackedSubject> subjects;
+    int next_id = 0;
+    int frame_count = 0;
+    float iou_threshold = 0.3f;
+    int max_missing_frames = 15;
+
+    static float iou(const cv::Rect& a, const cv::Rect& b) {
+        float intersection = (float)(a & b).area();
+        float total = (float)(a.area() + b.area()) - intersection;
+        return total > 0 ? intersection / total : 0.0f;
+    }
+
+public:
+    SubjectTracker() {}
+
+    // Returns one identity per face, in the order of faces
+    std::vector<int> update(const std::vector<cv::Rect>& faces) {
+        frame_count++;
+        std::vector<int> ids(faces.size(), -1);
+        std::vector<bool> claimed(subjects.size(), false);
+
+        for (size_t i = 0; i < faces.size(); i++) {
+            int best = -1;
+            float best_iou = iou_threshold;
+            for (size_t j = 0; j < subjects.size(); j++) {
+                float overlap = iou(faces[i], subjects[j].face);
+                if (!claimed[j] && overlap > best_iou) {
+                    best = (int)j;
+                    best_iou = overlap;
+                }
+            }
+
+            if (best >= 0) {
+                claimed[best] = true;
+                subjects[best].face = faces[i];
+                subjects[best].last_seen = frame_count;
+                ids[i] = subjects[best].id;
+            }
+            else {
+                subjects.push_back({ next_id, faces[i], frame_count });
+                claimed.push_back(true);
+                ids[i] = next_id++;
+            }
+        }
+
+        // Forget subjects that left the scene
+        subjects.erase(std::remove_if(subjects.begin(), subjects.end(), [this](const TrackedSubject& subject) {
+            return frame_count - subject.last_seen > max_missing_frames;
+        }), subjects.end());
+
+        return ids;
+    }
+
+    void reset() {
+        subjects.clear();
+    }
+};
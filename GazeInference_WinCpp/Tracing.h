@@ -0,0 +1,150 @@
+#pragma once
+#include "framework.h"
+
+/*
+* Scoped trace spans for timeline analysis (Chrome trace / Perfetto JSON).
+*
+*   TRACE_SCOPE("stage");            // span from here to the end of the scope
+*   TRACE_THREAD_NAME("capture");    // label of the calling thread
+*   TRACE_FLUSH("trace.json");       // write all buffered spans
+*
+* Compiled out entirely unless USE_TRACING is defined. When enabled, each
+* thread appends to its own fixed-size ring (no locks, no allocation), the
+* oldest spans are overwritten when it is full.
+*/
+#ifdef USE_TRACING
+
+#include <mutex>
+#include <sstream>
+
+struct TraceEvent {
+    const char* name;   // string literal, never copied
+    int64_t begin_ns;
+    int64_t end_ns;
+};
+
+class TraceBuffer {
+public:
+    static const uint64_t CAPACITY = 1 << 14;
+
+    std::array<TraceEvent, CAPACITY> events;
+    std::atomic<uint64_t> head{ 0 };
+    DWORD thread_id = GetCurrentThreadId();
+    std::string thread_name;
+
+    void push(const TraceEvent& event) {
+        uint64_t index = head.load(std::memory_order_relaxed);
+        events[index % CAPACITY] = event;
+        head.store(index + 1, std::memory_order_release);
+    }
+};
+
+class Tracer {
+private:
+    std::mutex mutex; // guards buffers, only taken on thread registration and flush
+    std::vector<std::unique_ptr<TraceBuffer>> buffers;
+    std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+
+    Tracer() {}
+
+    TraceBuffer* register_thread() {
+        std::lock_guard<std::mutex> lock(mutex);
+        buffers.push_back(std::make_unique<TraceBuffer>());
+        return buffers.back().get();
+    }
+
+public:
+    static Tracer& instance() {
+        static Tracer tracer;
+        return tracer;
+    }
+
+    // Buffers live as long as the tracer, so spans of finished threads are kept
+    TraceBuffer* thread_buffer() {
+        thread_local TraceBuffer* buffer = register_thread();
+        return buffer;
+    }
+
+    int64_t now_ns() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+    }
+
+    void set_thread_name(const char* name) {
+        TraceBuffer* buffer = thread_buffer();
+        std::lock_guard<std::mutex> lock(mutex);
+        buffer->thread_name = name;
+    }
+
+    bool flush(const std::string& path) {
+        std::ostringstream json;
+        json.setf(std::ios::fixed);
+        json.precision(3);
+        json << "{\"traceEvents\":[\n";
+        bool first = true;
+        DWORD pid = GetCurrentProcessId();
+
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto& buffer : buffers) {
+            if (!buffer->thread_name.empty()) {
+                json << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid
+                    << ",\"tid\":" << buffer->thread_id << ",\"args\":{\"name\":\"" << buffer->thread_name << "\"}}";
+                first = false;
+            }
+
+            // Copy the ring, then drop the slots the writer may have reused meanwhile
+            uint64_t end = buffer->head.load(std::memory_order_acquire);
+            uint64_t begin = end > TraceBuffer::CAPACITY ? end - TraceBuffer::CAPACITY : 0;
+            std::vector<TraceEvent> events;
+            for (uint64_t i = begin; i < end; i++) {
+                events.push_back(buffer->events[i % TraceBuffer::CAPACITY]);
+            }
+            uint64_t reused = buffer->head.load(std::memory_order_acquire);
+            uint64_t valid_from = reused >= TraceBuffer::CAPACITY ? reused - TraceBuffer::CAPACITY + 1 : 0;
+
+            for (uint64_t i = std::max(begin, valid_from); i < end; i++) {
+                const TraceEvent& event = events[i - begin];
+                json << (first ? "" : ",\n") << "{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":" << pid
+                    << ",\"tid\":" << buffer->thread_id << ",\"ts\":" << event.begin_ns / 1000.0
+                    << ",\"dur\":" << (event.end_ns - event.begin_ns) / 1000.0 << "}";
+                first = false;
+            }
+        }
+        json << "\n]}\n";
+
+        std::ofstream out(path, std::ios::trunc);
+        if (!out.is_open()) {
+            LOG_ERROR("Cannot write trace %s\n", path.c_str());
+            return false;
+        }
+        out << json.str();
+        return out.good();
+    }
+};
+
+class TraceScope {
+private:
+    const char* name;
+    int64_t begin_ns;
+
+public:
+    TraceScope(const char* name) : name{ name }, begin_ns{ Tracer::instance().now_ns() } {}
+
+    ~TraceScope() {
+        Tracer& tracer = Tracer::instance();
+        tracer.thread_buffer()->push({ name, begin_ns, tracer.now_ns() });
+    }
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(name)
+#define TRACE_THREAD_NAME(name) Tracer::instance().set_thread_name(name)
+#define TRACE_FLUSH(path) Tracer::instance().flush(path)
+
+#else
+
+#define TRACE_SCOPE(name)
+#define TRACE_THREAD_NAME(name)
+#define TRACE_FLUSH(path) (false)
+
+#endif
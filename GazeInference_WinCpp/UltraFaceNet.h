@@ -53,6 +53,20 @@ public:
     UltraFaceNet(const wchar_t* modelFilePath)
         : Model{ modelFilePath }
     {
+        init_priors();
+    }
+
+    UltraFaceNet(std::shared_ptr<AssetBundle> bundle, const std::string& section)
+        : Model{ bundle, section }
+    {
+        init_priors();
+    }
+
+    ~UltraFaceNet() {
+        // Cleanup 
+    }
+
+    void init_priors() {
         w_h_list = { in_w, in_h };
         for (auto size : w_h_list) {
             std::vector<float> fm_item;
@@ -87,10 +101,6 @@ public:
         /* generate prior anchors finished */
     }
 
-    ~UltraFaceNet() {
-        // Cleanup 
-    }
-
     bool initCamera() {
         live_capture = std::make_unique<LiveCapture>(0, 30, cv::Size(640, 480));
         live_capture->open();
@@ -155,6 +165,16 @@ public:
         return face_list;
     }
 
+    int anchor_count() {
+        return num_anchors;
+    }
+
+    // Frame size the generateBBox boxes are scaled to
+    void set_image_size(cv::Size size) {
+        image_w = size.width;
+        image_h = size.height;
+    }
+
     void generateBBox(std::vector<FaceInfo>& bbox_collection, std::vector<float> scores, std::vector<float> boxes, float score_threshold, int num_anchors) {
         for (int i = 0; i < num_anchors; i++) {
             if (scores[i * 2 + 1] > score_threshold) {
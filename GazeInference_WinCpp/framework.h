@@ -40,6 +40,7 @@
 #include <strsafe.h>
 #include <thread>
 #include <future>
+#include <atomic>
 
 
 // Headers for Media Foundation
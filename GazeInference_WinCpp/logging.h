@@ -6,6 +6,15 @@
 #define LOG_WARN(...)
 #define LOG_ERROR(...)
 
+// Compile-time filter for the Windows and desktop backends, lower levels compile to nothing
+#define LOG_LEVEL_VERBOSE 0
+#define LOG_LEVEL_DEBUG 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_ERROR 3
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_VERBOSE
+#endif
+
 // _WIN32, __unix__, __APPLE__, __linux__, __FreeBSD__, __ANDROID__
 
 #ifdef __ANDROID__
@@ -43,32 +52,57 @@ extern "C" {
 
 #include <windows.h>
 #include <stdio.h>
+#include <string>
 
+#ifdef USE_SYNC_LOGGING
+/*
+* Formats and prints on the calling thread. Slow, but nothing is lost if the
+* process dies right after the message.
+*/
 template<typename... Args> void DebugPrint(const char* type, const char* format, Args... args) {
-    size_t label_size = snprintf(NULL, 0, "[%s] ", type);
-    size_t message_size = snprintf(NULL, 0, format, args...);
-
-    // Create msg using formatting
-    char* buffer = (char*)calloc(label_size + message_size + 1, sizeof(char)); // +1 for /0
-    sprintf_s(buffer, label_size + 1, "[%s] ", type);
-    sprintf_s(buffer + label_size, message_size + 1, format, args...);
-    OutputDebugStringA(buffer);
-}
+    int label_size = snprintf(NULL, 0, "[%s] ", type);
+    int message_size = snprintf(NULL, 0, format, args...);
 
+    std::string buffer(label_size + message_size + 1, '\0'); // +1 for /0
+    sprintf_s(&buffer[0], label_size + 1, "[%s] ", type);
+    sprintf_s(&buffer[label_size], message_size + 1, format, args...);
+    OutputDebugStringA(buffer.c_str());
+}
+#define LOG_WRITE(type, format, ...) DebugPrint(type, format, ##__VA_ARGS__);
+#else
+#include "BinaryLogger.h"
+#define LOG_WRITE(type, format, ...) BINARY_LOG(type, format, ##__VA_ARGS__);
+#endif
 
-#define LOG_VERBOSE(format, ...) DebugPrint("VERBOSE", format, ##__VA_ARGS__);
-#define LOG_DEBUG(format, ...) DebugPrint("DEBUG", format, ##__VA_ARGS__);
-#define LOG_WARN(format, ...) DebugPrint("WARNING",format, ##__VA_ARGS__);
-#define LOG_ERROR(format, ...) DebugPrint("ERROR", format, ##__VA_ARGS__);
+#if LOG_LEVEL <= LOG_LEVEL_VERBOSE
+#define LOG_VERBOSE(format, ...) LOG_WRITE("VERBOSE", format, ##__VA_ARGS__)
+#endif
+#if LOG_LEVEL <= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(format, ...) LOG_WRITE("DEBUG", format, ##__VA_ARGS__)
+#endif
+#if LOG_LEVEL <= LOG_LEVEL_WARN
+#define LOG_WARN(format, ...) LOG_WRITE("WARNING", format, ##__VA_ARGS__)
+#endif
+#if LOG_LEVEL <= LOG_LEVEL_ERROR
+#define LOG_ERROR(format, ...) LOG_WRITE("ERROR", format, ##__VA_ARGS__)
+#endif
 
 #else // Non-mobile platform
 
-#include <iostream>
+#include "BinaryLogger.h"
 
-#define LOG_VERBOSE(...) std::clog << __VA_ARGS__ << std::endl;
-#define LOG_DEBUG(...) std::clog << __VA_ARGS__ << std::endl;
-#define LOG_WARN(...) std::clog << __VA_ARGS__ << std::endl;
-#define LOG_ERROR(...) std::cerr << __VA_ARGS__ << std::endl;
+#if LOG_LEVEL <= LOG_LEVEL_VERBOSE
+#define LOG_VERBOSE(format, ...) BINARY_LOG("VERBOSE", format, ##__VA_ARGS__);
+#endif
+#if LOG_LEVEL <= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(format, ...) BINARY_LOG("DEBUG", format, ##__VA_ARGS__);
+#endif
+#if LOG_LEVEL <= LOG_LEVEL_WARN
+#define LOG_WARN(format, ...) BINARY_LOG("WARNING", format, ##__VA_ARGS__);
+#endif
+#if LOG_LEVEL <= LOG_LEVEL_ERROR
+#define LOG_ERROR(format, ...) BINARY_LOG("ERROR", format, ##__VA_ARGS__);
+#endif
 
 #endif
 